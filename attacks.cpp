@@ -0,0 +1,191 @@
+#include "attacks.h"
+
+namespace attacks {
+    bitboard knightAttacks[64];
+    bitboard kingAttacks[64];
+    bitboard pawnAttacks[2][64];
+
+    bitboard between[64][64];
+    bitboard line[64][64];
+
+    magic_entry bishopMagics[64];
+    magic_entry rookMagics[64];
+
+    //Shared lookup tables for all squares, sized for the sum of 2^(relevant occupancy bits) over every square
+    static bitboard bishopTable[5248];
+    static bitboard rookTable[102400];
+
+    static const int bishopDirs[4][2] = { { -1, -1 }, { -1, 1 }, { 1, -1 }, { 1, 1 } };
+    static const int rookDirs[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+    static bool onBoard(int row, int col) {
+        return row >= 0 && row < 8 && col >= 0 && col < 8;
+    }
+
+    static bitboard leaperAttacks(int sq, const int offsets[8][2]) {
+        bitboard result = 0;
+
+        for(int i = 0; i < 8; ++i) {
+            int row = ROW_OF(sq) + offsets[i][0];
+            int col = COL_OF(sq) + offsets[i][1];
+
+            if(onBoard(row, col)) {
+                result |= SQUARE_BB(SQUARE(row, col));
+            }
+        }
+
+        return result;
+    }
+
+    //Walks each ray one square at a time, only used to build the lookup tables
+    static bitboard slidingAttacks(int sq, bitboard occupied, const int dirs[4][2]) {
+        bitboard result = 0;
+
+        for(int i = 0; i < 4; ++i) {
+            int row = ROW_OF(sq) + dirs[i][0];
+            int col = COL_OF(sq) + dirs[i][1];
+
+            while(onBoard(row, col)) {
+                result |= SQUARE_BB(SQUARE(row, col));
+
+                if(occupied & SQUARE_BB(SQUARE(row, col))) {
+                    break;
+                }
+
+                row += dirs[i][0];
+                col += dirs[i][1];
+            }
+        }
+
+        return result;
+    }
+
+    //Squares whose occupancy affects the attacks from sq. The last square of each ray never blocks anything.
+    static bitboard relevantOccupancy(int sq, const int dirs[4][2]) {
+        bitboard result = 0;
+
+        for(int i = 0; i < 4; ++i) {
+            int row = ROW_OF(sq) + dirs[i][0];
+            int col = COL_OF(sq) + dirs[i][1];
+
+            while(onBoard(row + dirs[i][0], col + dirs[i][1])) {
+                result |= SQUARE_BB(SQUARE(row, col));
+                row += dirs[i][0];
+                col += dirs[i][1];
+            }
+        }
+
+        return result;
+    }
+
+    //xorshift64*, fixed seed so magic generation is deterministic
+    static bitboard randomState = 1070372ULL;
+
+    static bitboard random64() {
+        randomState ^= randomState >> 12;
+        randomState ^= randomState << 25;
+        randomState ^= randomState >> 27;
+        return randomState * 2685821657736338717ULL;
+    }
+
+    static bitboard sparseRandom64() {
+        return random64() & random64() & random64();
+    }
+
+    static void initMagics(magic_entry magics[64], bitboard* table, const int dirs[4][2]) {
+        bitboard occupancies[4096];
+        bitboard references[4096];
+        int epoch[4096] = {};
+        int attempt = 0;
+
+        for(int sq = 0; sq < 64; ++sq) {
+            magic_entry& m = magics[sq];
+
+            m.mask = relevantOccupancy(sq, dirs);
+            m.shift = 64 - POP_COUNT(m.mask);
+            m.attacks = table;
+
+            //Enumerate every subset of the mask (Carry-Rippler)
+            int size = 0;
+            bitboard b = 0;
+            do {
+                occupancies[size] = b;
+                references[size] = slidingAttacks(sq, b, dirs);
+                size++;
+                b = (b - m.mask) & m.mask;
+            } while(b);
+
+            table += size;
+
+            bool found = false;
+            while(!found) {
+                m.magic = sparseRandom64();
+
+                if(POP_COUNT((m.mask * m.magic) >> 56) < 6) {
+                    continue;
+                }
+
+                ++attempt;
+                found = true;
+
+                for(int i = 0; i < size; ++i) {
+                    unsigned int idx = m.index(occupancies[i]);
+
+                    if(epoch[idx] < attempt) {
+                        epoch[idx] = attempt;
+                        m.attacks[idx] = references[i];
+                    }
+                    else if(m.attacks[idx] != references[i]) {
+                        found = false;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void initialize() {
+        const int knightOffsets[8][2] = {
+            { -1, -2 }, { -2, -1 }, { -1, 2 }, { -2, 1 },
+            {  1, -2 }, {  2, -1 }, {  1, 2 }, {  2, 1 }
+        };
+
+        const int kingOffsets[8][2] = {
+            { -1, -1 }, { -1, 0 }, { -1, 1 }, { 0, -1 },
+            {  0,  1 }, {  1, -1 }, { 1, 0 }, { 1,  1 }
+        };
+
+        for(int sq = 0; sq < 64; ++sq) {
+            knightAttacks[sq] = leaperAttacks(sq, knightOffsets);
+            kingAttacks[sq] = leaperAttacks(sq, kingOffsets);
+
+            //White pawns move towards row 0, black pawns towards row 7
+            const bitboard b = SQUARE_BB(sq);
+            pawnAttacks[0][sq] = ((b & ~FILE_A_BB) >> 9) | ((b & ~FILE_H_BB) >> 7);
+            pawnAttacks[1][sq] = ((b & ~FILE_A_BB) << 7) | ((b & ~FILE_H_BB) << 9);
+        }
+
+        initMagics(bishopMagics, bishopTable, bishopDirs);
+        initMagics(rookMagics, rookTable, rookDirs);
+
+        for(int from = 0; from < 64; ++from) {
+            for(int to = 0; to < 64; ++to) {
+                between[from][to] = 0;
+                line[from][to] = 0;
+
+                if(from == to) {
+                    continue;
+                }
+
+                if(bishopAttacks(from, 0) & SQUARE_BB(to)) {
+                    between[from][to] = bishopAttacks(from, SQUARE_BB(to)) & bishopAttacks(to, SQUARE_BB(from));
+                    line[from][to] = (bishopAttacks(from, 0) & bishopAttacks(to, 0)) | SQUARE_BB(from) | SQUARE_BB(to);
+                }
+                else if(rookAttacks(from, 0) & SQUARE_BB(to)) {
+                    between[from][to] = rookAttacks(from, SQUARE_BB(to)) & rookAttacks(to, SQUARE_BB(from));
+                    line[from][to] = (rookAttacks(from, 0) & rookAttacks(to, 0)) | SQUARE_BB(from) | SQUARE_BB(to);
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
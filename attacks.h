@@ -0,0 +1,48 @@
+#ifndef ATTACKS_H
+#define ATTACKS_H
+
+#include "bitboard.h"
+
+namespace attacks {
+    struct magic_entry {
+        bitboard mask;
+        bitboard magic;
+        bitboard* attacks;
+        unsigned int shift;
+
+        unsigned int index(const bitboard occupied) const {
+            return (unsigned int)(((occupied & mask) * magic) >> shift);
+        }
+    };
+
+    extern bitboard knightAttacks[64];
+    extern bitboard kingAttacks[64];
+    //Indexed [0] for white pawns, [1] for black pawns
+    extern bitboard pawnAttacks[2][64];
+
+    //Squares strictly between two squares on a shared line, empty if they are not aligned
+    extern bitboard between[64][64];
+    //The whole board-edge to board-edge line through two squares, empty if they are not aligned
+    extern bitboard line[64][64];
+
+    extern magic_entry bishopMagics[64];
+    extern magic_entry rookMagics[64];
+
+    void initialize();
+
+    inline bitboard bishopAttacks(const int sq, const bitboard occupied) {
+        const magic_entry& m = bishopMagics[sq];
+        return m.attacks[m.index(occupied)];
+    }
+
+    inline bitboard rookAttacks(const int sq, const bitboard occupied) {
+        const magic_entry& m = rookMagics[sq];
+        return m.attacks[m.index(occupied)];
+    }
+
+    inline bitboard queenAttacks(const int sq, const bitboard occupied) {
+        return bishopAttacks(sq, occupied) | rookAttacks(sq, occupied);
+    }
+}
+
+#endif
\ No newline at end of file
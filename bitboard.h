@@ -0,0 +1,37 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+//Squares are numbered row * 8 + col with row 0 being the 8th rank, matching the move coordinates
+//(a8 = 0, h8 = 7, a1 = 56, h1 = 63)
+typedef unsigned long long bitboard;
+
+#define SQUARE(row, col) (((row) << 3) + (col))
+#define ROW_OF(sq) ((sq) >> 3)
+#define COL_OF(sq) ((sq) & 7)
+#define SQUARE_BB(sq) (1ULL << (sq))
+
+#define POP_COUNT(bb) (__builtin_popcountll(bb))
+#define LSB(bb) (__builtin_ctzll(bb))
+
+#define FILE_A_BB 0x0101010101010101ULL
+#define FILE_H_BB 0x8080808080808080ULL
+#define ROW_BB(row) (0xFFULL << ((row) * 8))
+
+//Removes the least significant square from the bitboard and returns it
+inline int popLsb(bitboard& bb) {
+    const int sq = LSB(bb);
+    bb &= bb - 1;
+    return sq;
+}
+
+//Shifts a set of squares one row towards the 8th rank (white's forward direction)
+inline bitboard shiftUp(const bitboard bb) {
+    return bb >> 8;
+}
+
+//Shifts a set of squares one row towards the 1st rank (black's forward direction)
+inline bitboard shiftDown(const bitboard bb) {
+    return bb << 8;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include <atomic>
+#include <cstdio>
+#include <new>
+
+#include "evalcache.h"
+#include "statistics.h"
+
+//Each entry packs the upper 32 bits of the key with the score into one word, so a reader sees either
+//the whole old entry or the whole new one and never needs a lock. The lower key bits pick the slot.
+static std::atomic<unsigned long long>* evalCache = nullptr;
+static size_t evalCacheSize;
+
+#define KEY_BITS 0xFFFFFFFF00000000ULL
+
+bool initEvalCache(size_t sizeInMb) {
+    const size_t size = sizeInMb * 1024 * 1024 / sizeof(std::atomic<unsigned long long>);
+    std::atomic<unsigned long long>* cache = new(std::nothrow) std::atomic<unsigned long long>[size];
+
+    if(cache == nullptr) {
+        return false;
+    }
+
+    delete[] evalCache;
+    evalCache = cache;
+    evalCacheSize = size;
+    clearEvalCache();
+
+    return true;
+}
+
+void clearEvalCache() {
+    for(size_t i = 0; i < evalCacheSize; i++) {
+        evalCache[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool probeEvalCache(unsigned long long key, int& score) {
+    const unsigned long long entry = evalCache[key % evalCacheSize].load(std::memory_order_relaxed);
+
+    if(entry != 0 && (entry & KEY_BITS) == (key & KEY_BITS)) {
+        countEvent(EVAL_HITS);
+        score = (int)(unsigned int)entry;
+        return true;
+    }
+
+    countEvent(EVAL_MISSES);
+
+    return false;
+}
+
+void storeEvalCache(unsigned long long key, int score) {
+    evalCache[key % evalCacheSize].store((key & KEY_BITS) | (unsigned int)score, std::memory_order_relaxed);
+}
+
+void prefetchEvalCache(unsigned long long key) {
+    __builtin_prefetch(&evalCache[key % evalCacheSize]);
+}
+
+void printEvalCacheStatistics() {
+    const unsigned long long hits = counterTotal(EVAL_HITS);
+    const unsigned long long misses = counterTotal(EVAL_MISSES);
+
+    printf("Eval hits: %llu\n", hits);
+    printf("Eval misses: %llu\n", misses);
+    printf("Eval hit %%: %.2f\n", (float)hits/(hits + misses) * 100);
+}
\ No newline at end of file
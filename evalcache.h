@@ -0,0 +1,14 @@
+#ifndef EVALCACHE_H
+#define EVALCACHE_H
+
+#include <cstddef>
+
+//Sizes are in megabytes. Resizing keeps the old cache if the memory isn't available and returns false.
+bool initEvalCache(size_t sizeInMb);
+void clearEvalCache();
+bool probeEvalCache(unsigned long long key, int& score);
+void storeEvalCache(unsigned long long key, int score);
+void prefetchEvalCache(unsigned long long key);
+void printEvalCacheStatistics();
+
+#endif
\ No newline at end of file
@@ -1,6 +1,9 @@
-#include "evaluation.h"
+#include <algorithm>
 
-#define PIECE_AT(row, col) (game->currentState.board[row + 2][col + 2])
+#include "evaluation.h"
+#include "attacks.h"
+#include "pawntable.h"
+#include "evalcache.h"
 
 //Pawns should move toward opposite end, also encourage the 2 center pawns to move out
 const int pawnPositionScores[8][8] = {
@@ -62,7 +65,6 @@ const int queenPositionScores[8][8] = {
     {   0,   0,   0,   0,   0,   0,   0,   0 }
 };
 
-//TODO: Need different scores for end game
 //King should stay back and try to castle and avoid corners
 const int kingPositionScores[8][8] = {
     {-100,  -5,  -5,  -5,  -5,  -5,  -5,-100 },
@@ -75,77 +77,293 @@ const int kingPositionScores[8][8] = {
     {-100,   0,  10,   0,   0,   0,  10,-100 }
 };
 
-int evaluate(Game* game) {
+//In the endgame pawns are worth more the closer they are to promoting
+const int pawnEndgamePositionScores[8][8] = {
+    {   0,   0,   0,   0,   0,   0,   0,   0 },
+    {  80,  80,  80,  80,  80,  80,  80,  80 },
+    {  50,  50,  50,  50,  50,  50,  50,  50 },
+    {  30,  30,  30,  30,  30,  30,  30,  30 },
+    {  15,  15,  15,  15,  15,  15,  15,  15 },
+    {   5,   5,   5,   5,   5,   5,   5,   5 },
+    {   0,   0,   0,   0,   0,   0,   0,   0 },
+    {   0,   0,   0,   0,   0,   0,   0,   0 }
+};
+
+//Once the queens are gone the king is a fighting piece and should head for the center
+const int kingEndgamePositionScores[8][8] = {
+    { -50, -30, -30, -30, -30, -30, -30, -50 },
+    { -30, -10,   0,   0,   0,   0, -10, -30 },
+    { -30,   0,  20,  30,  30,  20,   0, -30 },
+    { -30,   0,  30,  40,  40,  30,   0, -30 },
+    { -30,   0,  30,  40,  40,  30,   0, -30 },
+    { -30,   0,  20,  30,  30,  20,   0, -30 },
+    { -30, -10,   0,   0,   0,   0, -10, -30 },
+    { -50, -30, -30, -30, -30, -30, -30, -50 }
+};
+
+const int pieceValues[7] = { 0, 100, 320, 330, 500, 900, 100000 };
+
+//How much each piece type counts towards the middlegame, the starting position adds up to MAX_PHASE
+const int phaseValues[7] = { 0, 0, 1, 1, 2, 4, 0 };
+
+//Position tables are laid out from white's point of view, black reads them mirrored.
+//Only pawns and the king play differently enough in the endgame to need their own table.
+const int (*positionTables[2][7])[8] = {
+    {
+        0,
+        pawnPositionScores,
+        knightPositionScores,
+        bishopPositionScores,
+        rookPositionScores,
+        queenPositionScores,
+        kingPositionScores
+    },
+    {
+        0,
+        pawnEndgamePositionScores,
+        knightPositionScores,
+        bishopPositionScores,
+        rookPositionScores,
+        queenPositionScores,
+        kingEndgamePositionScores
+    }
+};
+
+//Pawn structure scores, [0] middlegame and [1] endgame
+const int isolatedPawnScores[2] = { -15, -20 };
+const int doubledPawnScores[2] = { -10, -20 };
+const int chainedPawnScores[2] = { 10, 5 };
+
+//Passed pawn bonus by row from white's point of view, the endgame table adds to the pawn position scores
+const int passedPawnScores[2][8] = {
+    { 0, 60, 40, 25, 15, 10,  5,  0 },
+    { 0, 90, 60, 40, 25, 15, 10,  0 }
+};
+
+//Extra endgame bonus for a passed pawn whose next square is empty
+const int freePassedPawnScores[8] = { 0, 40, 25, 15, 10, 5, 0, 0 };
+
+//Mobility scores per reachable square, [0] middlegame and [1] endgame, indexed by PieceType. The
+//baseline is subtracted first so a piece with average freedom scores nothing.
+const int mobilityScores[2][7] = {
+    { 0, 0, 4, 5, 2, 1, 0 },
+    { 0, 0, 4, 5, 4, 2, 0 }
+};
+const int mobilityBaselines[7] = { 0, 0, 4, 6, 6, 12, 0 };
+
+//Weight of each attacked square around the enemy king, indexed by PieceType
+const int kingAttackWeights[7] = { 0, 0, 2, 2, 3, 5, 0 };
+
+//Bonus for a knight, bishop, rook or queen defended by its own side, [0] middlegame and [1] endgame
+const int protectedPieceScores[2] = { 5, 3 };
+
+//Squares in front of a pawn on its own and neighbouring files, indexed by COLOUR_INDEX
+static bitboard passedPawnMasks[2][64];
+static bitboard fileMasks[8];
+static bitboard adjacentFileMasks[8];
+
+int pieceMaterial[13];
+int piecePhases[13];
+int pieceSquareScores[2][13][64];
+
+void initEvaluation() {
+    for(int type = Pawn; type <= King; ++type) {
+        const Piece white = MAKE_PIECE(type, WHITE);
+        const Piece black = MAKE_PIECE(type, BLACK);
+
+        pieceMaterial[white] = pieceValues[type];
+        pieceMaterial[black] = -pieceValues[type];
+
+        piecePhases[white] = phaseValues[type];
+        piecePhases[black] = phaseValues[type];
+
+        for(int stage = MIDDLEGAME; stage <= ENDGAME; ++stage) {
+            for(int sq = 0; sq < 64; ++sq) {
+                pieceSquareScores[stage][white][sq] = positionTables[stage][type][ROW_OF(sq)][COL_OF(sq)];
+                pieceSquareScores[stage][black][sq] = -positionTables[stage][type][7 - ROW_OF(sq)][COL_OF(sq)];
+            }
+        }
+    }
+
+    for(int col = 0; col < 8; ++col) {
+        fileMasks[col] = FILE_A_BB << col;
+        adjacentFileMasks[col] = (col > 0 ? FILE_A_BB << (col - 1) : 0) | (col < 7 ? FILE_A_BB << (col + 1) : 0);
+    }
+
+    for(int sq = 0; sq < 64; ++sq) {
+        const bitboard files = fileMasks[COL_OF(sq)] | adjacentFileMasks[COL_OF(sq)];
+
+        //White pawns move towards row 0
+        passedPawnMasks[0][sq] = files & (SQUARE_BB(sq) - 1) & ~ROW_BB(ROW_OF(sq));
+        passedPawnMasks[1][sq] = files & ~(SQUARE_BB(sq) - 1) & ~ROW_BB(ROW_OF(sq));
+    }
+}
+
+template<Colour Us>
+static void evaluatePawns(const gameState& state, int scores[2], bitboard& passedPawns) {
+    const Colour Them = Us == WHITE ? BLACK : WHITE;
+    const bitboard pawns = state.pieceBB[Pawn] & state.colourBB[COLOUR_INDEX(Us)];
+    const bitboard enemyPawns = state.pieceBB[Pawn] & state.colourBB[COLOUR_INDEX(Them)];
+
+    passedPawns = 0;
+
+    bitboard remaining = pawns;
+    while(remaining) {
+        const int sq = popLsb(remaining);
+        const int col = COL_OF(sq);
+        const int row = Us == WHITE ? ROW_OF(sq) : 7 - ROW_OF(sq);
+
+        for(int stage = MIDDLEGAME; stage <= ENDGAME; ++stage) {
+            if(!(pawns & adjacentFileMasks[col])) {
+                scores[stage] += Us * isolatedPawnScores[stage];
+            }
+
+            //Only the rearmost of the doubled pawns is penalised
+            if(pawns & fileMasks[col] & passedPawnMasks[COLOUR_INDEX(Us)][sq]) {
+                scores[stage] += Us * doubledPawnScores[stage];
+            }
+
+            //Defended by a friendly pawn, which sits where an enemy pawn on sq would attack
+            if(attacks::pawnAttacks[COLOUR_INDEX(Them)][sq] & pawns) {
+                scores[stage] += Us * chainedPawnScores[stage];
+            }
+        }
+
+        if(!(enemyPawns & passedPawnMasks[COLOUR_INDEX(Us)][sq]) && !(pawns & fileMasks[col] & passedPawnMasks[COLOUR_INDEX(Us)][sq])) {
+            passedPawns |= SQUARE_BB(sq);
+            scores[MIDDLEGAME] += Us * passedPawnScores[MIDDLEGAME][row];
+            scores[ENDGAME] += Us * passedPawnScores[ENDGAME][row];
+        }
+    }
+}
+
+//Pawn structure only depends on the pawns so the result is cached by the pawn hash
+static void probePawns(const gameState& state, pawn_entry& entry) {
+    if(!probePawnTable(state, entry)) {
+        entry.scores[MIDDLEGAME] = 0;
+        entry.scores[ENDGAME] = 0;
+
+        evaluatePawns<WHITE>(state, entry.scores, entry.passedPawns[0]);
+        evaluatePawns<BLACK>(state, entry.scores, entry.passedPawns[1]);
+
+        storePawnTable(state, entry);
+    }
+}
+
+//Passed pawns with a clear next square are worth more, this depends on the other pieces so isn't cached
+template<Colour Us>
+static int freePassedPawns(const gameState& state, bitboard passedPawns) {
     int score = 0;
 
-    for(int i = 0; i < 8; ++i) {
-        for(int j = 0; j < 8; ++j) {
-            Piece p = PIECE_AT(i, j);
-
-            switch(p) {
-                //Black pieces
-                case bP: 
-                    score += 100;    
-                    score += pawnPositionScores[7-i][j];
-                    break;
-                case bN: 
-                    score += 320; 
-                    score += knightPositionScores[7-i][j];
-                    break;
-                case bB: 
-                    score += 330; 
-                    score += bishopPositionScores[7-i][j];
-                    break;
-                case bR: 
-                    score += 500; 
-                    score += rookPositionScores[7-i][j];
-                    break;
-                case bQ: 
-                    score += 900; 
-                    score += queenPositionScores[7-i][j];
-                    break;
-                case bK: 
-                    score += 100000; 
-                    score += kingPositionScores[7-i][j];
-                    break;
-
-                //White pieces
-                case wP: 
-                    score -= 100;
-                    score -= pawnPositionScores[i][j];
-                    break;
-                case wN: 
-                    score -= 320;
-                    score -= knightPositionScores[i][j];
-                    break;
-                case wB: 
-                    score -= 330; 
-                    score -= bishopPositionScores[i][j];
-                    break;
-                case wR: 
-                    score -= 500;
-                    score -= rookPositionScores[i][j];
-                    break;
-                case wQ: 
-                    score -= 900; 
-                    score -= queenPositionScores[i][j];
-                    break;
-                case wK: 
-                    score -= 100000;
-                    score -= kingPositionScores[i][j];
-                    break;
-                default: break;
+    while(passedPawns) {
+        const int sq = popLsb(passedPawns);
+        const int stopSq = Us == WHITE ? sq - 8 : sq + 8;
+
+        if(!(state.occupied & SQUARE_BB(stopSq))) {
+            score += freePassedPawnScores[Us == WHITE ? ROW_OF(sq) : 7 - ROW_OF(sq)];
+        }
+    }
+
+    return Us * score;
+}
+
+template<Colour Us>
+static inline bitboard pawnAttackSpan(const bitboard pawns) {
+    return Us == WHITE ? ((pawns & ~FILE_A_BB) >> 9) | ((pawns & ~FILE_H_BB) >> 7) :
+        ((pawns & ~FILE_A_BB) << 7) | ((pawns & ~FILE_H_BB) << 9);
+}
+
+//Mobility, attacks on the enemy king zone and protected pieces, all from attack bitboards
+template<Colour Us>
+static void evaluatePieces(const gameState& state, int& middlegame, int& endgame) {
+    const Colour Them = Us == WHITE ? BLACK : WHITE;
+    const bitboard ours = state.colourBB[COLOUR_INDEX(Us)];
+    const bitboard pawns = state.pieceBB[Pawn] & ours;
+    const bitboard enemyPawns = state.pieceBB[Pawn] & state.colourBB[COLOUR_INDEX(Them)];
+    const int enemyKingSq = state.kingSquare[COLOUR_INDEX(Them)];
+
+    //Squares attacked by enemy pawns are not counted as safe to move to
+    const bitboard mobilityArea = ~ours & ~pawnAttackSpan<Them>(enemyPawns);
+    const bitboard kingZone = attacks::kingAttacks[enemyKingSq] | SQUARE_BB(enemyKingSq);
+
+    bitboard attacked = pawnAttackSpan<Us>(pawns) | attacks::kingAttacks[state.kingSquare[COLOUR_INDEX(Us)]];
+    int kingAttackers = 0;
+    int kingAttackWeight = 0;
+
+    for(int type = Knight; type <= Queen; ++type) {
+        bitboard pieces = state.pieceBB[type] & ours;
+
+        while(pieces) {
+            const int sq = popLsb(pieces);
+            bitboard targets;
+
+            switch(type) {
+                case Knight: targets = attacks::knightAttacks[sq]; break;
+                case Bishop: targets = attacks::bishopAttacks(sq, state.occupied); break;
+                case Rook: targets = attacks::rookAttacks(sq, state.occupied); break;
+                default: targets = attacks::queenAttacks(sq, state.occupied); break;
             }
+
+            const int mobility = POP_COUNT(targets & mobilityArea) - mobilityBaselines[type];
+            middlegame += Us * mobility * mobilityScores[MIDDLEGAME][type];
+            endgame += Us * mobility * mobilityScores[ENDGAME][type];
+
+            if(targets & kingZone) {
+                ++kingAttackers;
+                kingAttackWeight += POP_COUNT(targets & kingZone) * kingAttackWeights[type];
+            }
+
+            attacked |= targets;
         }
     }
 
-    //Mobility score?
+    //A single attacker is rarely dangerous. King safety fades out with the middlegame weight.
+    if(kingAttackers >= 2) {
+        middlegame += Us * kingAttackWeight * kingAttackers;
+    }
+
+    const bitboard pieces = ours & ~state.pieceBB[Pawn] & ~state.pieceBB[King];
+    const int protectedPieces = POP_COUNT(pieces & attacked);
+    middlegame += Us * protectedPieces * protectedPieceScores[MIDDLEGAME];
+    endgame += Us * protectedPieces * protectedPieceScores[ENDGAME];
+}
+
+int evaluate(Game* game) {
+    const gameState& state = game->currentState;
+
+    //Cached scores are from white's point of view, the key already includes the side to move
+    int score;
+    if(probeEvalCache(state.hashCode, score)) {
+        return state.turn * score;
+    }
+
+    if(nnue::enabled) {
+        score = nnue::evaluate(state.accumulator, COLOUR_INDEX(state.turn));
+        storeEvalCache(state.hashCode, state.turn * score);
+        return score;
+    }
+
+    //Material and piece-square totals are kept up to date by the board as pieces move. Middlegame and
+    //endgame scores are blended by how much material is left, promotions can push phase past the maximum.
+    const int phase = std::min(state.phase, MAX_PHASE);
+
+    int middlegame = state.pieceSquare[MIDDLEGAME];
+    int endgame = state.pieceSquare[ENDGAME];
+
+    //Mobility, king safety and protected pieces
+    evaluatePieces<WHITE>(state, middlegame, endgame);
+    evaluatePieces<BLACK>(state, middlegame, endgame);
 
-    //Protect king
+    //Pawn structure
+    pawn_entry pawns;
+    probePawns(state, pawns);
+    middlegame += pawns.scores[MIDDLEGAME];
+    endgame += pawns.scores[ENDGAME];
+    endgame += freePassedPawns<WHITE>(state, pawns.passedPawns[0]) + freePassedPawns<BLACK>(state, pawns.passedPawns[1]);
 
-    //Sentries
+    score = state.material + (middlegame * phase + endgame * (MAX_PHASE - phase)) / MAX_PHASE;
 
-    //Pawn structure (isolated, blocked)
+    storeEvalCache(state.hashCode, score);
 
-    return -game->currentState.turn * score;
+    return state.turn * score;
 }
\ No newline at end of file
@@ -3,6 +3,12 @@
 
 #include "game.h"
 
+//Scores are signed from white's point of view so both colours can be summed together. Indexed by Piece (and square).
+extern int pieceMaterial[13];
+extern int pieceSquareScores[2][13][64]; //Indexed by GameStage first
+extern int piecePhases[13];
+
+void initEvaluation();
 int evaluate(Game* game);
 
-#endif
+#endif
\ No newline at end of file
@@ -1,13 +1,21 @@
+#include <algorithm>
 #include <cstdlib>
 #include <sstream>
 
 #include "game.h"
+#include "attacks.h"
+#include "evaluation.h"
+#include "pvtable.h"
+#include "pawntable.h"
+#include "evalcache.h"
 #include "zobrist.h"
 #include "utils.h"
 #include "debug.h"
 
-#define SET_PIECE(row, col, piece) (currentState.board[row + 2][col + 2] = piece)
-#define PIECE_AT(row, col)         (currentState.board[row + 2][col + 2])
+#define PIECE_AT(row, col) (currentState.board[SQUARE(row, col)])
+
+//Comment out to stop makeMove prefetching the table entries the search will probe next
+#define PREFETCH_TABLES
 
 const PieceType pieceTypes[14] = {
     Empty,
@@ -61,9 +69,58 @@ const int MvvLVA [7][7] = {
         { 0, 99, 99, 99, 99, 99, 99 }, //king
 };
 
+//Rough piece values for exchange evaluation, the king is worth more than everything else put together
+const int seeValues[7] = { 0, 100, 320, 330, 500, 900, 20000 };
+
+//Castle permissions that survive a move from or to each square
+const unsigned int castlePermMasks[64] = {
+     7, 15, 15, 15,  3, 15, 15, 11,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    13, 15, 15, 15, 12, 15, 15, 14
+};
+
+static inline move createMove(const int from, const int to, const MoveFlag flag = MOVE_NORMAL, const PieceType promotion = Knight) {
+    return { (unsigned short)(from | (to << 6) | ((promotion - Knight) << 12) | (flag << 14)) };
+}
+
+//Squares a non-pawn piece of the side to move may land on. The enemy king is never a target.
+template<Colour Us>
+static inline bitboard moveTargets(const gameState& state, MoveGenType genType) {
+    const bitboard enemies = state.colourBB[COLOUR_INDEX(Us) ^ 1] & ~state.pieceBB[King];
+
+    switch(genType) {
+        case GEN_CAPTURES: return enemies;
+        case GEN_QUIETS: return ~state.occupied;
+        default: return enemies | ~state.occupied;
+    }
+}
+
+template<Colour Us>
+static inline bitboard pawnPushes(const bitboard pawns) {
+    return Us == WHITE ? shiftUp(pawns) : shiftDown(pawns);
+}
+
+//Destinations of pawn captures towards the a-file
+template<Colour Us>
+static inline bitboard pawnCapturesWest(const bitboard pawns) {
+    return Us == WHITE ? (pawns & ~FILE_A_BB) >> 9 : (pawns & ~FILE_A_BB) << 7;
+}
+
+//Destinations of pawn captures towards the h-file
+template<Colour Us>
+static inline bitboard pawnCapturesEast(const bitboard pawns) {
+    return Us == WHITE ? (pawns & ~FILE_H_BB) >> 7 : (pawns & ~FILE_H_BB) << 9;
+}
+
 void Game::startPosition(const std::string& fen) {
-    stateHistory = std::vector<gameState>();
+    historyLength = 0;
 
+    currentState = gameState();
     currentState.turn = WHITE;
     currentState.castlePerm = 0;
     currentState.enPass = NO_EN_PASS;
@@ -71,18 +128,6 @@ void Game::startPosition(const std::string& fen) {
     std::vector<std::string> parts;
     split(fen, parts);
 
-    //Initialize off_board squares
-    for(int i = 0; i < 12; ++i) {
-        currentState.board[0][i] = off_board;
-        currentState.board[1][i] = off_board;
-        currentState.board[10][i] = off_board;
-        currentState.board[11][i] = off_board;
-        currentState.board[i][0] = off_board;
-        currentState.board[i][1] = off_board;
-        currentState.board[i][10] = off_board;
-        currentState.board[i][11] = off_board;
-    }
-
     //Position
     std::string position = parts[0];
     int x = 0;
@@ -95,13 +140,10 @@ void Game::startPosition(const std::string& fen) {
             x = 0;
         }
         else if(c >= '0' && c <= '9') {
-            for(int i = 0; i < c - '0'; i++) {
-                SET_PIECE(y, x, empty);
-                ++x;
-            }
+            x += c - '0';
         }
         else if(c != ' ') {
-            SET_PIECE(y, x, getPiece(c));
+            putPiece(getPiece(c), SQUARE(y, x));
             ++x;
         }
     }
@@ -125,842 +167,867 @@ void Game::startPosition(const std::string& fen) {
     }
 
     //Fifty move
-    currentState.fiftyMove = std::stoi(parts[4]);
+    currentState.fiftyMove = std::min(std::stoi(parts[4]), MAX_FIFTY_MOVE);
 
     //Turns
     currentState.turns = std::stoi(parts[5]);
 
+    if(nnue::enabled) {
+        nnue::refresh(currentState.accumulator, currentState);
+    }
+
+    //Check status
+    const int us = COLOUR_INDEX(currentState.turn);
+    currentState.checkers = attackersTo(currentState.kingSquare[us], currentState.occupied) & currentState.colourBB[1 - us];
+
     //Set hash code
     currentState.hashCode = 0;
+    currentState.pawnHashCode = 0;
 
-    for(int row = 0; row < 8; row++) {
-        for(int col = 0; col < 8; col++) {
-            Piece p = PIECE_AT(row, col);
+    bitboard occupied = currentState.occupied;
+    while(occupied) {
+        int sq = popLsb(occupied);
+        currentState.hashCode ^= zobrist::pieceHashes[sq][currentState.board[sq]];
 
-            if(p != empty) {
-                currentState.hashCode ^= zobrist::pieceHashes[row][col][p];
-            }
+        if(pieceTypes[currentState.board[sq]] == Pawn) {
+            currentState.pawnHashCode ^= zobrist::pieceHashes[sq][currentState.board[sq]];
         }
     }
 
-    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass.y][currentState.enPass.x];
+    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass];
     currentState.hashCode ^= zobrist::castlePermHashes[currentState.castlePerm];
     currentState.hashCode ^= zobrist::turnHashes[currentState.turn == WHITE ? 0 : 1];
 }
 
-void Game::makeMove(const move& m) {
-    stateHistory.push_back(currentState);
+void Game::putPiece(const Piece piece, const int sq) {
+    const bitboard b = SQUARE_BB(sq);
+
+    currentState.board[sq] = piece;
+    currentState.pieceBB[pieceTypes[piece]] |= b;
+    currentState.colourBB[COLOUR_INDEX(pieceColours[piece])] |= b;
+    currentState.occupied |= b;
+    currentState.pieceCounts[piece]++;
+    currentState.material += pieceMaterial[piece];
+    currentState.pieceSquare[MIDDLEGAME] += pieceSquareScores[MIDDLEGAME][piece][sq];
+    currentState.pieceSquare[ENDGAME] += pieceSquareScores[ENDGAME][piece][sq];
+    currentState.phase += piecePhases[piece];
+
+    if(nnue::enabled) {
+        nnue::addPiece(currentState.accumulator, piece, sq);
+    }
 
-    //Hash update
-    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass.y][currentState.enPass.x];
-    currentState.hashCode ^= zobrist::castlePermHashes[currentState.castlePerm];
-    currentState.hashCode ^= zobrist::turnHashes[currentState.turn == WHITE ? 0 : 1];
+    if(pieceTypes[piece] == King) {
+        currentState.kingSquare[COLOUR_INDEX(pieceColours[piece])] = sq;
+    }
+}
 
-    const Piece p = PIECE_AT(m.fromY, m.fromX);
-    const Piece capturedPiece = PIECE_AT(m.toY, m.toX);
+void Game::removePiece(const int sq) {
+    const Piece piece = currentState.board[sq];
+    const bitboard b = SQUARE_BB(sq);
+
+    currentState.board[sq] = empty;
+    currentState.pieceBB[pieceTypes[piece]] ^= b;
+    currentState.colourBB[COLOUR_INDEX(pieceColours[piece])] ^= b;
+    currentState.occupied ^= b;
+    currentState.pieceCounts[piece]--;
+    currentState.material -= pieceMaterial[piece];
+    currentState.pieceSquare[MIDDLEGAME] -= pieceSquareScores[MIDDLEGAME][piece][sq];
+    currentState.pieceSquare[ENDGAME] -= pieceSquareScores[ENDGAME][piece][sq];
+    currentState.phase -= piecePhases[piece];
+
+    if(nnue::enabled) {
+        nnue::removePiece(currentState.accumulator, piece, sq);
+    }
+}
 
-    //Don't actually care about 50 move rule
-    // if(p == bP || p == wP || PIECE_AT(m.toY, m.toX) != empty || (currentState.enPass != NO_EN_PASS && m.toX == currentState.enPass.x && m.toY == currentState.enPass.y)) {
-    //     //Pawn move or capture, reset 50 move rule
-    //     currentState.fiftyMove = 0;
-    // }
-    // else {
-    //     ++currentState.fiftyMove;
-    // }
+void Game::movePiece(const int from, const int to) {
+    const Piece piece = currentState.board[from];
+    const bitboard fromTo = SQUARE_BB(from) | SQUARE_BB(to);
 
-    //Remove captured piece from hash
-    if(capturedPiece != empty) {
-        currentState.hashCode ^= zobrist::pieceHashes[m.toY][m.toX][capturedPiece];
+    currentState.board[to] = piece;
+    currentState.board[from] = empty;
+    currentState.pieceBB[pieceTypes[piece]] ^= fromTo;
+    currentState.colourBB[COLOUR_INDEX(pieceColours[piece])] ^= fromTo;
+    currentState.occupied ^= fromTo;
+    currentState.pieceSquare[MIDDLEGAME] += pieceSquareScores[MIDDLEGAME][piece][to] - pieceSquareScores[MIDDLEGAME][piece][from];
+    currentState.pieceSquare[ENDGAME] += pieceSquareScores[ENDGAME][piece][to] - pieceSquareScores[ENDGAME][piece][from];
+
+    if(nnue::enabled) {
+        nnue::movePiece(currentState.accumulator, piece, from, to);
     }
 
-    //Move piece
-    if(m.promotion != Empty) {
-        Piece promotion = getPiece(m.promotion, currentState.turn);
-        currentState.hashCode ^= zobrist::pieceHashes[m.toY][m.toX][promotion];    
-        SET_PIECE(m.toY, m.toX, promotion);
+    if(pieceTypes[piece] == King) {
+        currentState.kingSquare[COLOUR_INDEX(pieceColours[piece])] = to;
+    }
+}
+
+void Game::makeMove(const move& m) {
+    if(currentState.turn == WHITE) {
+        makeMove<WHITE>(m);
     }
     else {
-        currentState.hashCode ^= zobrist::pieceHashes[m.toY][m.toX][p];
-        SET_PIECE(m.toY, m.toX, p);
+        makeMove<BLACK>(m);
     }
+}
 
-    //En passant capture
-    if(currentState.enPass != NO_EN_PASS && pieceTypes[p] == Pawn && m.toX == currentState.enPass.x && m.toY == currentState.enPass.y) {
-        if(currentState.turn == WHITE) {
-            currentState.hashCode ^= zobrist::pieceHashes[currentState.enPass.y + 1][currentState.enPass.x][bP];
-            SET_PIECE(currentState.enPass.y + 1, currentState.enPass.x, empty);
-        }
-        else {
-            currentState.hashCode ^= zobrist::pieceHashes[currentState.enPass.y - 1][currentState.enPass.x][wP];
-            SET_PIECE(currentState.enPass.y - 1, currentState.enPass.x, empty);
-        }
+template<Colour Us>
+void Game::makeMove(const move& m) {
+    const Colour Them = Us == WHITE ? BLACK : WHITE;
+
+    ASSERT(currentState.turn == Us);
+
+    const int from = m.from();
+    const int to = m.to();
+    const Piece p = currentState.board[from];
+    const Piece capturedPiece = currentState.board[to];
 
-        currentState.enPass = NO_EN_PASS;
+    keyHistory[HISTORY_INDEX(historyLength)] = currentState.hashCode;
+    undo_record& undo = history[HISTORY_INDEX(historyLength++)];
+    undo.pawnHashCode = currentState.pawnHashCode;
+    undo.move = m;
+    undo.capturedPiece = capturedPiece;
+    undo.castlePerm = currentState.castlePerm;
+    undo.enPass = currentState.enPass;
+    undo.fiftyMove = currentState.fiftyMove;
+    undo.checkers = currentState.checkers;
+
+    //Hash update
+    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass];
+    currentState.hashCode ^= zobrist::castlePermHashes[currentState.castlePerm];
+    currentState.hashCode ^= zobrist::turnHashes[COLOUR_INDEX(Us)];
+
+    //Pawn moves and captures can't be undone, which resets the fifty move rule and bounds repetition checks
+    if(pieceTypes[p] == Pawn || capturedPiece != empty) {
+        currentState.fiftyMove = 0;
+    }
+    else if(currentState.fiftyMove < MAX_FIFTY_MOVE) {
+        ++currentState.fiftyMove;
     }
 
-    //Remove piece from old location
-    currentState.hashCode ^= zobrist::pieceHashes[m.fromY][m.fromX][p];
-    SET_PIECE(m.fromY, m.fromX, empty);
+    //Remove captured piece
+    if(capturedPiece != empty) {
+        currentState.hashCode ^= zobrist::pieceHashes[to][capturedPiece];
 
-    //Update castling permissions for captured rooks
-    if(capturedPiece == bR) {
-        if(m.toX == 0 && m.toY == 0) {
-            currentState.castlePerm &= ~q;
-        }
-        else if(m.toX == 7 && m.toY == 0) {
-            currentState.castlePerm &= ~k;
+        if(pieceTypes[capturedPiece] == Pawn) {
+            currentState.pawnHashCode ^= zobrist::pieceHashes[to][capturedPiece];
         }
+
+        removePiece(to);
     }
-    else if(capturedPiece == wR) {
-        if(m.toX == 0 && m.toY == 7) {
-            currentState.castlePerm &= ~Q;
-        }
-        else if(m.toX == 7 && m.toY == 7) {
-            currentState.castlePerm &= ~K;
+
+    //En passant capture, the captured pawn sits one row behind the en passant square
+    if(m.flag() == MOVE_EN_PASSANT) {
+        const int capturedSq = Us == WHITE ? to + 8 : to - 8;
+        undo.capturedPiece = currentState.board[capturedSq];
+        currentState.hashCode ^= zobrist::pieceHashes[capturedSq][currentState.board[capturedSq]];
+        currentState.pawnHashCode ^= zobrist::pieceHashes[capturedSq][currentState.board[capturedSq]];
+        removePiece(capturedSq);
+    }
+
+    //Move piece
+    currentState.hashCode ^= zobrist::pieceHashes[from][p];
+    movePiece(from, to);
+
+    //Pawn structure key, a promoting pawn leaves the pawn structure
+    if(pieceTypes[p] == Pawn) {
+        currentState.pawnHashCode ^= zobrist::pieceHashes[from][p];
+
+        if(m.flag() != MOVE_PROMOTION) {
+            currentState.pawnHashCode ^= zobrist::pieceHashes[to][p];
         }
     }
 
+    if(m.flag() == MOVE_PROMOTION) {
+        Piece promotion = MAKE_PIECE(m.promotion(), Us);
+        currentState.hashCode ^= zobrist::pieceHashes[to][promotion];
+        removePiece(to);
+        putPiece(promotion, to);
+    }
+    else {
+        currentState.hashCode ^= zobrist::pieceHashes[to][p];
+    }
+
     //Move rooks for castling
-    if(p == bK && m.toX == m.fromX - 2) {
-        //Black king side
-        currentState.hashCode ^= zobrist::pieceHashes[0][m.toX + 1][bR];
-        currentState.hashCode ^= zobrist::pieceHashes[0][0][bR];
-        currentState.castlePerm &= ~q;
-        SET_PIECE(0, m.toX + 1, bR);
-        SET_PIECE(0, 0, empty);
-    }
-    else if(p == bK && m.toX == m.fromX + 2) {
-        //Black queen side
-        currentState.hashCode ^= zobrist::pieceHashes[0][m.toX - 1][bR];
-        currentState.hashCode ^= zobrist::pieceHashes[0][7][bR];
-        currentState.castlePerm &= ~k;
-        SET_PIECE(0, m.toX - 1, bR);
-        SET_PIECE(0, 7, empty);
-    }
-    else if(p == wK && m.toX == m.fromX - 2) {
-        //White king side
-        currentState.hashCode ^= zobrist::pieceHashes[7][m.toX + 1][wR];
-        currentState.hashCode ^= zobrist::pieceHashes[7][0][wR];
-        currentState.castlePerm &= ~Q;
-        SET_PIECE(7, m.toX + 1, wR);
-        SET_PIECE(7, 0, empty);
-    }
-    else if(p == wK && m.toX == m.fromX + 2) {
-        //White queen side
-        currentState.hashCode ^= zobrist::pieceHashes[7][m.toX - 1][wR];
-        currentState.hashCode ^= zobrist::pieceHashes[7][7][wR];
-        currentState.castlePerm &= ~K;
-        SET_PIECE(7, m.toX - 1, wR);
-        SET_PIECE(7, 7, empty);
+    if(m.flag() == MOVE_CASTLING) {
+        const int row = Us == WHITE ? 7 : 0;
+        const Piece rook = MAKE_PIECE(Rook, Us);
+        const int rookFrom = COL_OF(to) == 6 ? SQUARE(row, 7) : SQUARE(row, 0);
+        const int rookTo = COL_OF(to) == 6 ? SQUARE(row, 5) : SQUARE(row, 3);
+
+        currentState.hashCode ^= zobrist::pieceHashes[rookFrom][rook];
+        currentState.hashCode ^= zobrist::pieceHashes[rookTo][rook];
+        movePiece(rookFrom, rookTo);
     }
 
     //Reset en pasant
     currentState.enPass = NO_EN_PASS;
 
     //En passant
-    if((p == bP || p == wP) && std::abs(m.fromY - m.toY) > 1) {
-        currentState.enPass = EN_PASS(m.fromX, (unsigned int)(m.fromY < m.toY ? m.fromY + 1 : m.fromY - 1));
+    if(pieceTypes[p] == Pawn && std::abs(from - to) == 16) {
+        currentState.enPass = (from + to) / 2;
     }
 
-    //Update castling permissions
-    if(p == wK) {
-        //Moved king, both permissions lost
-        currentState.castlePerm &= ~Q;
-        currentState.castlePerm &= ~K;
-    }
-    else if(p == bK) {
-        //Moved king, both permissions lost
-        currentState.castlePerm &= ~q;
-        currentState.castlePerm &= ~k;
+    //Update castling permissions for moved kings and moved or captured rooks
+    currentState.castlePerm &= castlePermMasks[from] & castlePermMasks[to];
+
+    currentState.turn = Them;
+    ++currentState.turns;
+
+    //Hash
+    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass];
+    currentState.hashCode ^= zobrist::castlePermHashes[currentState.castlePerm];
+    currentState.hashCode ^= zobrist::turnHashes[COLOUR_INDEX(Them)];
+
+#ifdef PREFETCH_TABLES
+    //The child probes these straight away, start the loads now so they overlap with the check detection
+    //and move generation instead of stalling the probe
+    prefetchPvTable(currentState.hashCode);
+    prefetchEvalCache(currentState.hashCode);
+
+    if(currentState.pawnHashCode != undo.pawnHashCode) {
+        prefetchPawnTable(currentState.pawnHashCode);
     }
-    else if(p == wR && m.fromX == 0 && m.fromY == 7) {
-        //White queen side
-        currentState.castlePerm &= ~Q;
+#endif
+
+    //Update check status. Moves are legal so only the side now to move can be in check.
+    currentState.checkers = attackersTo(currentState.kingSquare[COLOUR_INDEX(Them)], currentState.occupied) & currentState.colourBB[COLOUR_INDEX(Us)];
+}
+
+void Game::undoLastMove() {
+    //The move being undone was made by the side not currently to move
+    if(currentState.turn == WHITE) {
+        undoLastMove<BLACK>();
     }
-    else if(p == wR && m.fromX == 7 && m.fromY == 7) {
-        //White king side
-        currentState.castlePerm &= ~K;
+    else {
+        undoLastMove<WHITE>();
     }
-    else if(p == bR && m.fromX == 0 && m.fromY == 0) {
-        //Black queen side
-        currentState.castlePerm &= ~q;
+}
+
+template<Colour Us>
+void Game::undoLastMove() {
+    ASSERT(historyLength > 0);
+
+    const undo_record& undo = history[HISTORY_INDEX(--historyLength)];
+    const int from = undo.move.from();
+    const int to = undo.move.to();
+
+    currentState.turn = Us;
+    --currentState.turns;
+
+    const MoveFlag flag = undo.move.flag();
+
+    if(flag == MOVE_PROMOTION) {
+        removePiece(to);
+        putPiece(MAKE_PIECE(Pawn, Us), to);
     }
-    else if(p == bR && m.fromX == 7 && m.fromY == 0) {
-        //Black king side
-        currentState.castlePerm &= ~k;
+
+    movePiece(to, from);
+
+    //Move rooks back for castling
+    if(flag == MOVE_CASTLING) {
+        const int row = Us == WHITE ? 7 : 0;
+        const int rookFrom = COL_OF(to) == 6 ? SQUARE(row, 7) : SQUARE(row, 0);
+        const int rookTo = COL_OF(to) == 6 ? SQUARE(row, 5) : SQUARE(row, 3);
+
+        movePiece(rookTo, rookFrom);
     }
 
-    //Update check status
-    for(int i = 0; i < 8; ++i) {
-        for(int j = 0; j < 8; ++j) {
-            Piece kingPiece = PIECE_AT(i, j);
-            if(kingPiece == wK) {
-                currentState.whiteInCheck = isAttacked(j, i, BLACK);
-            }
-            else if(kingPiece == bK) {
-                currentState.blackInCheck = isAttacked(j, i, WHITE);
-            }
+    //Put back captured piece, which for en passant is one row behind the destination
+    if(undo.capturedPiece != empty) {
+        if(flag == MOVE_EN_PASSANT) {
+            putPiece((Piece)undo.capturedPiece, Us == WHITE ? to + 8 : to - 8);
+        }
+        else {
+            putPiece((Piece)undo.capturedPiece, to);
         }
     }
 
+    currentState.castlePerm = undo.castlePerm;
+    currentState.enPass = undo.enPass;
+    currentState.fiftyMove = undo.fiftyMove;
+    currentState.checkers = undo.checkers;
+    currentState.hashCode = keyHistory[HISTORY_INDEX(historyLength)];
+    currentState.pawnHashCode = undo.pawnHashCode;
+}
+
+//Passes the turn without moving anything, for null move pruning. Only valid when not in check. The history
+//record holds NO_MOVE so the pass can be told apart from a real move.
+void Game::makeNullMove() {
+    ASSERT(!currentState.checkers);
+
+    keyHistory[HISTORY_INDEX(historyLength)] = currentState.hashCode;
+    undo_record& undo = history[HISTORY_INDEX(historyLength++)];
+    undo.pawnHashCode = currentState.pawnHashCode;
+    undo.move = NO_MOVE;
+    undo.capturedPiece = empty;
+    undo.castlePerm = currentState.castlePerm;
+    undo.enPass = currentState.enPass;
+    undo.fiftyMove = currentState.fiftyMove;
+    undo.checkers = currentState.checkers;
+
+    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass];
+    currentState.hashCode ^= zobrist::turnHashes[COLOUR_INDEX(currentState.turn)];
+
+    //Positions before a pass can't repeat in the line after it, so the pass counts as irreversible
+    currentState.enPass = NO_EN_PASS;
+    currentState.fiftyMove = 0;
     currentState.turn = (Colour)-currentState.turn;
     ++currentState.turns;
 
-    //Hash
-    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass.y][currentState.enPass.x];
-    currentState.hashCode ^= zobrist::castlePermHashes[currentState.castlePerm];
-    currentState.hashCode ^= zobrist::turnHashes[currentState.turn == WHITE ? 0 : 1];
+    currentState.hashCode ^= zobrist::enPassHashes[currentState.enPass];
+    currentState.hashCode ^= zobrist::turnHashes[COLOUR_INDEX(currentState.turn)];
 }
 
-void Game::undoLastMove() {
-    currentState = stateHistory.back();
-    stateHistory.pop_back();
+void Game::undoNullMove() {
+    ASSERT(historyLength > 0);
+
+    const undo_record& undo = history[HISTORY_INDEX(--historyLength)];
+
+    currentState.turn = (Colour)-currentState.turn;
+    --currentState.turns;
+
+    currentState.enPass = undo.enPass;
+    currentState.fiftyMove = undo.fiftyMove;
+    currentState.checkers = undo.checkers;
+    currentState.hashCode = keyHistory[HISTORY_INDEX(historyLength)];
 }
 
-const bool Game::isAttacked(unsigned int x, unsigned int y, const Colour attackingColour) {
-    if(pieceColours[PIECE_AT(y, x)] == attackingColour) {
-        //Cannot attack own side
-        return false;
+//Whether the side has anything besides pawns and its king, without which passing is often the best move
+const bool Game::hasNonPawnMaterial(const Colour colour) {
+    return currentState.colourBB[COLOUR_INDEX(colour)] & ~currentState.pieceBB[Pawn] & ~currentState.pieceBB[King];
+}
+
+const bool Game::isAttacked(const int sq, const Colour attackingColour) {
+    const bitboard attackers = currentState.colourBB[COLOUR_INDEX(attackingColour)];
+    const bitboard queens = currentState.pieceBB[Queen];
+
+    //A pawn attacks sq exactly when a pawn of the other colour on sq would attack the pawn
+    return (attacks::pawnAttacks[COLOUR_INDEX(-attackingColour)][sq] & currentState.pieceBB[Pawn] & attackers) ||
+        (attacks::knightAttacks[sq] & currentState.pieceBB[Knight] & attackers) ||
+        (attacks::kingAttacks[sq] & currentState.pieceBB[King] & attackers) ||
+        (attacks::bishopAttacks(sq, currentState.occupied) & (currentState.pieceBB[Bishop] | queens) & attackers) ||
+        (attacks::rookAttacks(sq, currentState.occupied) & (currentState.pieceBB[Rook] | queens) & attackers);
+}
+
+const bitboard Game::attackersTo(const int sq, const bitboard occupied) {
+    const bitboard queens = currentState.pieceBB[Queen];
+    const bitboard pawns = currentState.pieceBB[Pawn];
+
+    return (attacks::pawnAttacks[COLOUR_INDEX(BLACK)][sq] & pawns & currentState.colourBB[COLOUR_INDEX(WHITE)]) |
+        (attacks::pawnAttacks[COLOUR_INDEX(WHITE)][sq] & pawns & currentState.colourBB[COLOUR_INDEX(BLACK)]) |
+        (attacks::knightAttacks[sq] & currentState.pieceBB[Knight]) |
+        (attacks::kingAttacks[sq] & currentState.pieceBB[King]) |
+        (attacks::bishopAttacks(sq, occupied) & (currentState.pieceBB[Bishop] | queens)) |
+        (attacks::rookAttacks(sq, occupied) & (currentState.pieceBB[Rook] | queens));
+}
+
+//Pieces of the given colour that are the only thing standing between their king and an enemy slider
+const bitboard Game::pinnedPieces(const Colour colour) {
+    const int us = COLOUR_INDEX(colour);
+    const int kingSq = currentState.kingSquare[us];
+    const bitboard queens = currentState.pieceBB[Queen];
+
+    bitboard snipers = ((attacks::bishopAttacks(kingSq, 0) & (currentState.pieceBB[Bishop] | queens)) |
+        (attacks::rookAttacks(kingSq, 0) & (currentState.pieceBB[Rook] | queens))) & currentState.colourBB[1 - us];
+
+    bitboard pinned = 0;
+
+    while(snipers) {
+        const bitboard blockers = attacks::between[kingSq][popLsb(snipers)] & currentState.occupied;
+
+        if(blockers && !(blockers & (blockers - 1))) {
+            pinned |= blockers & currentState.colourBB[us];
+        }
     }
 
-    //Pawns
-    const int pawnMoveDir = attackingColour == BLACK ? 1 : -1;
+    return pinned;
+}
 
-    const Piece leftPawnDiag = PIECE_AT(y - pawnMoveDir, x - 1);
-    const Piece rightPawnDiag = PIECE_AT(y - pawnMoveDir, x + 1);
+const bool Game::isCapture(const move& m) {
+    return currentState.board[m.to()] != empty || m.flag() == MOVE_EN_PASSANT;
+}
 
-    if(pieceColours[leftPawnDiag] == attackingColour && pieceTypes[leftPawnDiag] == Pawn) {
-        return true;
+//Material won by the capture itself, including what a promotion adds
+const int Game::captureGain(const move& m) {
+    int gain = m.flag() == MOVE_EN_PASSANT ? seeValues[Pawn] : seeValues[pieceTypes[currentState.board[m.to()]]];
+
+    if(m.flag() == MOVE_PROMOTION) {
+        gain += seeValues[m.promotion()] - seeValues[Pawn];
     }
 
-    if(pieceColours[rightPawnDiag] == attackingColour && pieceTypes[rightPawnDiag] == Pawn) {
-        return true;
+    return gain;
+}
+
+//Static exchange evaluation. Plays out every capture on the destination square, each side always
+//recapturing with its least valuable piece and free to stop when carrying on would lose material, and
+//returns the material balance for the side making the move. Sliders behind a capturing piece join in as
+//it leaves. Pins are ignored.
+const int Game::staticExchange(const move& m) {
+    if(m.flag() == MOVE_CASTLING) {
+        return 0;
     }
 
-    //En passant
-    if(currentState.enPass != NO_EN_PASS && y == (unsigned int)(currentState.enPass.y - pawnMoveDir) && x == currentState.enPass.x) {
-        const Piece leftEnPassant = PIECE_AT(y, x - 1);
-        const Piece rightEnPassant = PIECE_AT(y, x + 1);
+    const int from = m.from();
+    const int to = m.to();
+    const bitboard bishops = currentState.pieceBB[Bishop] | currentState.pieceBB[Queen];
+    const bitboard rooks = currentState.pieceBB[Rook] | currentState.pieceBB[Queen];
 
-        if(pieceColours[leftEnPassant] == attackingColour && pieceTypes[leftEnPassant] == Pawn) {
-            return true;
+    bitboard occupied = currentState.occupied ^ SQUARE_BB(from);
+
+    if(m.flag() == MOVE_EN_PASSANT) {
+        occupied ^= SQUARE_BB(currentState.turn == WHITE ? to + 8 : to - 8);
+    }
+
+    //gain[d] is the balance for the side making the d-th capture if the exchange stopped there
+    int gain[32];
+    int d = 0;
+    gain[0] = captureGain(m);
+
+    int onSquare = m.flag() == MOVE_PROMOTION ? seeValues[m.promotion()] : seeValues[pieceTypes[currentState.board[from]]];
+    Colour side = (Colour)-currentState.turn;
+    bitboard attackers = attackersTo(to, occupied) & occupied;
+
+    while(d < 31) {
+        const bitboard sideAttackers = attackers & currentState.colourBB[COLOUR_INDEX(side)];
+
+        if(!sideAttackers) {
+            break;
+        }
+
+        int type = Pawn;
+        while(!(sideAttackers & currentState.pieceBB[type])) {
+            ++type;
         }
 
-        if(pieceColours[rightEnPassant] == attackingColour && pieceTypes[rightEnPassant] == Pawn) {
-            return true;
+        //The king can only take last
+        if(type == King && (attackers & currentState.colourBB[COLOUR_INDEX(-side)])) {
+            break;
         }
+
+        ++d;
+        gain[d] = onSquare - gain[d - 1];
+        onSquare = seeValues[type];
+
+        occupied ^= SQUARE_BB(LSB(sideAttackers & currentState.pieceBB[type]));
+
+        if(type == Pawn || type == Bishop || type == Queen) {
+            attackers |= attacks::bishopAttacks(to, occupied) & bishops;
+        }
+
+        if(type == Rook || type == Queen) {
+            attackers |= attacks::rookAttacks(to, occupied) & rooks;
+        }
+
+        attackers &= occupied;
+        side = (Colour)-side;
     }
 
-    //King
-    const Piece adjacentKings[8] = {
-        leftPawnDiag,
-        rightPawnDiag,
-        PIECE_AT(y + pawnMoveDir, x - 1),
-        PIECE_AT(y + pawnMoveDir, x + 1),
-        PIECE_AT(y, x -1),
-        PIECE_AT(y, x + 1),
-        PIECE_AT(y - 1, x),
-        PIECE_AT(y + 1, x)
-    };
+    while(d > 0) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+        --d;
+    }
 
-    for(int i = 0; i < 8; ++i) {
-        const Piece p = adjacentKings[i];
-        if(pieceColours[p] == attackingColour && pieceTypes[p] == King) {
-            return true;
+    return gain[0];
+}
+
+//Checks a move that did not come from the generator (e.g. from the transposition table) without generating
+//every move in the position
+const bool Game::isLegalMove(const move& m) {
+    const Colour turn = currentState.turn;
+    const int us = COLOUR_INDEX(turn);
+    const int from = m.from();
+    const int to = m.to();
+    const bitboard toBB = SQUARE_BB(to);
+    const Piece piece = currentState.board[from];
+
+    if(from == to || pieceColours[piece] != turn) {
+        return false;
+    }
+
+    if((currentState.colourBB[us] | currentState.pieceBB[King]) & toBB) {
+        return false;
+    }
+
+    if(pieceTypes[piece] == King || m.flag() == MOVE_EN_PASSANT) {
+        //King moves (castling in particular) and en passant have their own rules, check against the generator
+        move_list moves;
+
+        if(pieceTypes[piece] == King) {
+            turn == WHITE ? generateKingMoves<WHITE>(moves, GEN_ALL) : generateKingMoves<BLACK>(moves, GEN_ALL);
         }
+        else {
+            turn == WHITE ? generateEnPassantMoves<WHITE>(moves) : generateEnPassantMoves<BLACK>(moves);
+        }
+
+        for(int i = 0; i < moves.numMoves; ++i) {
+            if(moves.moves[i] == m) {
+                return true;
+            }
+        }
+
+        return false;
     }
-    
-    //Knights
-    const Piece adjacentKnights[8] = {
-        PIECE_AT(y - 1, x - 2),
-        PIECE_AT(y - 2, x - 1),
-        PIECE_AT(y - 1, x + 2),
-        PIECE_AT(y - 2, x + 1),
-        PIECE_AT(y + 1, x - 2),
-        PIECE_AT(y + 2, x - 1),
-        PIECE_AT(y + 1, x + 2),
-        PIECE_AT(y + 2, x + 1)
-    };
 
-    for(int i = 0; i < 8; ++i) {
-        const Piece p = adjacentKnights[i];
-        if(pieceColours[p] == attackingColour && pieceTypes[p] == Knight) {
-            return true;
-        }
-    }
-
-    //Bishop/Queen
-    int yDirsDiag[2] = { -1, 1 };
-    int xDirsDiag[2] = { -1, 1 };
-    for(int i = 0; i < 2; ++i) {
-        for(int j = 0; j < 2; ++j) {
-            int searchDirY = yDirsDiag[i];
-            int searchDirX = xDirsDiag[j];
-            int searchY = y;    
-            int searchX = x;
-            Piece p = empty;
-            do {
-                searchX += searchDirX;
-                searchY += searchDirY;
-                p = PIECE_AT(searchY, searchX);
-                if(p != empty && p != off_board) {
-                    const PieceType type = pieceTypes[p];
-                    if(pieceColours[p] == attackingColour && (type == Bishop || type == Queen)) {
-                        return true;
-                    }
+    if(m.flag() == MOVE_CASTLING || (m.flag() == MOVE_PROMOTION && pieceTypes[piece] != Pawn)) {
+        return false;
+    }
+
+    switch(pieceTypes[piece]) {
+        case Pawn: {
+            const int push = turn == WHITE ? -8 : 8;
+
+            //Pawn moves to the last row are always promotions
+            if((m.flag() == MOVE_PROMOTION) != ((toBB & (ROW_BB(0) | ROW_BB(7))) != 0)) {
+                return false;
+            }
+
+            if(currentState.board[to] != empty) {
+                if(!(attacks::pawnAttacks[us][from] & toBB)) {
+                    return false;
                 }
-            } while(p == empty);
-        }
-    }
-
-    //Rook/Queen    
-    int yDirsNonDiag[4] = { -1, 1, 0, 0 };
-    int xDirsNonDiag[4] = { 0, 0, -1, 1 };
-    for(int i = 0; i < 4; ++i) {
-        int searchDirY = yDirsNonDiag[i];
-        int searchDirX = xDirsNonDiag[i];
-        int searchY = y;
-        int searchX = x;
-        Piece p = empty;
-        do {
-            searchX += searchDirX;
-            searchY += searchDirY;
-            p = PIECE_AT(searchY, searchX);
-            if(p != empty && p != off_board) {
-                const PieceType type = pieceTypes[p];
-                if(pieceColours[p] == attackingColour && (type == Rook || type == Queen)) {
-                    return true;
+            }
+            else if(to == from + 2 * push) {
+                if(ROW_OF(from) != (turn == WHITE ? 6 : 1) || currentState.board[from + push] != empty) {
+                    return false;
                 }
             }
-        } while(p == empty);
+            else if(to != from + push) {
+                return false;
+            }
+            break;
+        }
+        case Knight:
+            if(!(attacks::knightAttacks[from] & toBB)) {
+                return false;
+            }
+            break;
+        case Bishop:
+            if(!(attacks::bishopAttacks(from, currentState.occupied) & toBB)) {
+                return false;
+            }
+            break;
+        case Rook:
+            if(!(attacks::rookAttacks(from, currentState.occupied) & toBB)) {
+                return false;
+            }
+            break;
+        case Queen:
+            if(!(attacks::queenAttacks(from, currentState.occupied) & toBB)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
     }
 
-    return false;
+    //Same restrictions the generator applies through the check and pin masks
+    const int kingSq = currentState.kingSquare[us];
+    const bitboard checkers = currentState.checkers;
+
+    if(checkers) {
+        if(checkers & (checkers - 1)) {
+            return false;
+        }
+
+        if(!((attacks::between[kingSq][LSB(checkers)] | checkers) & toBB)) {
+            return false;
+        }
+    }
+
+    if((pinnedPieces(turn) & SQUARE_BB(from)) && !(attacks::line[kingSq][from] & toBB)) {
+        return false;
+    }
+
+    return true;
 }
 
 void Game::addQuietMove(move_list& moveList, move move) {
-    ASSERT(move.fromX >= 0 && move.fromY >= 0 && move.toX < 8 && move.toY < 8);
+    ASSERT(move.from() != move.to());
 
-    moveList.addMove(move);
+    moveList.addMove(move, 0);
 }
 
 void Game::addCaptureMove(move_list& moveList, move move, const Piece pieceMoved, const Piece capturedPiece) {
-    ASSERT(move.fromX >=0 && move.fromY >= 0 && move.toX < 8 && move.toY < 8);
+    ASSERT(move.from() != move.to());
     ASSERT(pieceMoved != empty);
     ASSERT(pieceMoved != off_board);
     ASSERT(capturedPiece != empty);
-    ASSERT(pieceMoved != off_board);
+    ASSERT(pieceTypes[capturedPiece] != King);
 
-    if(pieceTypes[capturedPiece] == King) {
-        return;
-    }
-    
-    move.score = MvvLVA[pieceTypes[capturedPiece]][pieceTypes[pieceMoved]];
-    
-    moveList.addMove(move);
+    moveList.addMove(move, MvvLVA[pieceTypes[capturedPiece]][pieceTypes[pieceMoved]]);
 }
 
-void Game::generateMoves(move_list& moves, bool capturesOnly) {
-    for(unsigned int i = 0; i < 8; i++) {
-        for (unsigned int j = 0; j < 8; j++) {
-            Piece p = PIECE_AT(i, j);
+void Game::addMoves(move_list& moves, const int from, bitboard targets) {
+    const Piece piece = currentState.board[from];
 
-            if(pieceColours[p] != currentState.turn) {
-                continue;
-            }
+    while(targets) {
+        const int to = popLsb(targets);
+        const Piece capturedPiece = currentState.board[to];
 
-            switch(pieceTypes[p]) {
-                case Pawn: 
-                    generatePawnMoves(moves, j, i, capturesOnly);
-                    break;
-                case Knight:
-                    generateKnightMoves(moves, j, i, capturesOnly);
-                    break;
-                case Bishop:
-                    generateBishopMoves(moves, j, i, capturesOnly);
-                    break;
-                case Rook:
-                    generateRookMoves(moves, j, i, capturesOnly);
-                    break;
-                case Queen:
-                    generateQueenMoves(moves, j, i, capturesOnly);
-                    break;  
-                case King:
-                    generateKingMoves(moves, j, i, capturesOnly);
-                    break;
-                default:
-                    break;
-            }
+        if(capturedPiece != empty) {
+            addCaptureMove(moves, createMove(from, to), piece, capturedPiece);
+        }
+        else {
+            addQuietMove(moves, createMove(from, to));
         }
     }
 }
 
-void Game::generatePawnMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly) {
-    const Colour turn = currentState.turn;
-
-    Piece piece = PIECE_AT(y, x);
-
-    const int pawnMoveDir = turn == BLACK ? 1 : -1;
+template<Colour Us>
+void Game::addPawnMoves(move_list& moves, bitboard targets, const int fromOffset, const bool isCapture, const bitboard pinned) {
+    const bitboard promotionRow = ROW_BB(Us == WHITE ? 0 : 7);
+    const int kingSq = currentState.kingSquare[COLOUR_INDEX(Us)];
 
-    const Piece leftDiag = PIECE_AT(y + pawnMoveDir, x - 1);
-    const Piece rightDiag = PIECE_AT(y + pawnMoveDir, x + 1);
+    while(targets) {
+        const int to = popLsb(targets);
+        const int from = to + fromOffset;
+        const Piece piece = MAKE_PIECE(Pawn, Us);
 
-    //En passant capture left
-    if(currentState.enPass != NO_EN_PASS && currentState.enPass.x == x - 1 && currentState.enPass.y == y + pawnMoveDir) {
-        const Piece enPassPiece = PIECE_AT(y, x - 1);
-
-        ASSERT(enPassPiece != empty);
-
-        addCaptureMove(moves, {
-            x,
-            y,
-            x - 1,
-            y + pawnMoveDir
-        }, piece, enPassPiece);
-    }
-    //Regular capture left
-    else if(pieceColours[leftDiag] == -turn) {
-        ASSERT(leftDiag != empty);
+        //A pinned pawn can only move along the line to its king
+        if((pinned & SQUARE_BB(from)) && !(attacks::line[kingSq][from] & SQUARE_BB(to))) {
+            continue;
+        }
 
-        if(turn == WHITE && y == 1) {
-            //Promotion white
+        if(SQUARE_BB(to) & promotionRow) {
             for(int i = 0; i < 4; ++i) {
-                addCaptureMove(moves, {
-                    x,
-                    y,
-                    x - 1,
-                    y + pawnMoveDir,
-                    promotionTypes[i]
-                }, piece, leftDiag);
+                if(isCapture) {
+                    addCaptureMove(moves, createMove(from, to, MOVE_PROMOTION, promotionTypes[i]), piece, currentState.board[to]);
+                }
+                else {
+                    addQuietMove(moves, createMove(from, to, MOVE_PROMOTION, promotionTypes[i]));
+                }
             }
         }
-        else if(turn == BLACK && y == 6) {
-            //Promotion black
-            for(int i = 0; i < 4; ++i) {
-                addCaptureMove(moves, {
-                    x,
-                    y,
-                    x - 1,
-                    y + pawnMoveDir,
-                    promotionTypes[i]
-                }, piece, leftDiag);
-            }
+        else if(isCapture) {
+            addCaptureMove(moves, createMove(from, to), piece, currentState.board[to]);
         }
         else {
-            addCaptureMove(moves, {
-                x,
-                y,
-                x - 1,
-                y + pawnMoveDir
-            }, piece, leftDiag);
+            addQuietMove(moves, createMove(from, to));
         }
     }
+}
 
-    //En passant capture right
-    if(currentState.enPass != NO_EN_PASS && currentState.enPass.x == x + 1 && currentState.enPass.y == y + pawnMoveDir) {
-        const Piece enPassPiece = PIECE_AT(y, x + 1);
-
-        ASSERT(enPassPiece != empty);
+//Pawn pushes onto the last row. Queen promotions win material like a capture and are generated with the
+//captures, the under-promotions with the quiet moves.
+template<Colour Us>
+void Game::addPushPromotions(move_list& moves, bitboard targets, const int fromOffset, const bool queen, const bitboard pinned) {
+    const int kingSq = currentState.kingSquare[COLOUR_INDEX(Us)];
 
-        addCaptureMove(moves, {
-            x,
-            y,
-            x + 1,
-            y + pawnMoveDir
-        }, piece, enPassPiece);
-    }
-    //Regular capture right
-    else if(pieceColours[rightDiag] == -turn) {
-        ASSERT(rightDiag != empty);
+    while(targets) {
+        const int to = popLsb(targets);
+        const int from = to + fromOffset;
 
-        if(turn == WHITE && y == 1) {
-            for(int i = 0; i < 4; ++i) {
-                addCaptureMove(moves, {
-                    x,
-                    y,
-                    x + 1,
-                    y + pawnMoveDir,
-                    promotionTypes[i]
-                }, piece, rightDiag);
-            }
+        if((pinned & SQUARE_BB(from)) && !(attacks::line[kingSq][from] & SQUARE_BB(to))) {
+            continue;
         }
-        else if(turn == BLACK && y == 6) {
-            for(int i = 0; i < 4; ++i) {
-                addCaptureMove(moves, {
-                    x,
-                    y,
-                    x + 1,
-                    y + pawnMoveDir,
-                    promotionTypes[i]
-                }, piece, rightDiag);
-            }
+
+        if(queen) {
+            addQuietMove(moves, createMove(from, to, MOVE_PROMOTION, Queen));
         }
         else {
-            addCaptureMove(moves, {
-                x,
-                y,
-                x + 1,
-                y + pawnMoveDir
-            }, piece, rightDiag);
-        }
-    }
-
-    const Piece forwardOne = PIECE_AT(y + pawnMoveDir, x);
-
-    if(!capturesOnly) {
-        //Non capture move forward
-        if(forwardOne == empty) {
-            if(turn == WHITE && y == 1) {
-                //White promotion
-                for(int i = 0; i < 4; ++i) {
-                    addQuietMove(moves, {
-                        x,
-                        y,
-                        x,
-                        y + pawnMoveDir,
-                        promotionTypes[i]
-                    });
-                }
-            }
-            else if(turn == BLACK && y == 6) {
-                //Black promotion
-                for(int i = 0; i < 4; ++i) {
-                    addQuietMove(moves, {
-                        x,
-                        y,
-                        x,
-                        y + pawnMoveDir,
-                        promotionTypes[i]
-                    });
-                }
-            }
-            else {
-                addQuietMove(moves, {
-                    x,
-                    y,
-                    x,
-                    y + pawnMoveDir
-                });
+            for(int i = 0; i < 3; ++i) {
+                addQuietMove(moves, createMove(from, to, MOVE_PROMOTION, promotionTypes[i]));
             }
+        }
+    }
+}
+
+void Game::generateMoves(move_list& moves, MoveGenType genType) {
+    if(currentState.turn == WHITE) {
+        generateMoves<WHITE>(moves, genType);
+    }
+    else {
+        generateMoves<BLACK>(moves, genType);
+    }
+}
 
-            const Piece forwardTwo = PIECE_AT(y + (pawnMoveDir * 2), x);
+//Generates only legal moves. Pins and checks are worked out once up front so no move has to be made to test it.
+template<Colour Us>
+void Game::generateMoves(move_list& moves, MoveGenType genType) {
+    generateKingMoves<Us>(moves, genType);
 
-            //Double move forward from starting position
-            if(forwardTwo == empty && ((turn == BLACK && y == 1) || (turn == WHITE && y == 6))) {
-                addQuietMove(moves, {
-                    x,
-                    y,
-                    x,
-                    y + (pawnMoveDir * 2)
-                });
-            }
-        }
+    const bitboard checkers = currentState.checkers;
+
+    if(checkers & (checkers - 1)) {
+        //Double check, only the king can move
+        return;
     }
+
+    const int kingSq = currentState.kingSquare[COLOUR_INDEX(Us)];
+    const bitboard pinned = pinnedPieces(Us);
+
+    //When in check, other pieces must capture the checker or block between it and the king
+    const bitboard checkMask = checkers ? (attacks::between[kingSq][LSB(checkers)] | checkers) : ~0ULL;
+    const bitboard targets = moveTargets<Us>(currentState, genType) & checkMask;
+
+    generatePawnMoves<Us>(moves, genType, checkMask, pinned);
+    generateKnightMoves<Us>(moves, targets, pinned);
+    generateBishopMoves<Us>(moves, targets, pinned);
+    generateRookMoves<Us>(moves, targets, pinned);
+    generateQueenMoves<Us>(moves, targets, pinned);
 }
 
-void Game::generateKnightMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly) {
-    const Colour turn = currentState.turn;
+template<Colour Us>
+void Game::generatePawnMoves(move_list& moves, MoveGenType genType, const bitboard checkMask, const bitboard pinned) {
+    //Offsets lead from the destination back to the pawn
+    const int forward = Us == WHITE ? -8 : 8;
+    const int west = Us == WHITE ? -9 : 7;
+    const int east = Us == WHITE ? -7 : 9;
+    const bitboard doublePushRow = ROW_BB(Us == WHITE ? 4 : 3);
+    const bitboard promotionRow = ROW_BB(Us == WHITE ? 0 : 7);
 
-    Piece piece = PIECE_AT(y, x);
+    const bitboard pawns = currentState.pieceBB[Pawn] & currentState.colourBB[COLOUR_INDEX(Us)];
+    const bitboard forwardOne = pawnPushes<Us>(pawns) & ~currentState.occupied;
 
-    const int offsets[8][2] = {
-        { -1, -2 },
-        { -2, -1 },
-        { -1, +2 },
-        { -2, +1 },
-        { +1, -2 },
-        { +2, -1 },
-        { +1, +2 },
-        { +2, +1 }
-    };
+    if(genType != GEN_QUIETS) {
+        const bitboard enemies = currentState.colourBB[COLOUR_INDEX(Us) ^ 1] & ~currentState.pieceBB[King] & checkMask;
 
-    for(int i = 0; i < 8; ++i) {
-        Piece p = PIECE_AT(y + offsets[i][0], x + offsets[i][1]);
+        addPawnMoves<Us>(moves, pawnCapturesWest<Us>(pawns) & enemies, -west, true, pinned);
+        addPawnMoves<Us>(moves, pawnCapturesEast<Us>(pawns) & enemies, -east, true, pinned);
+        addPushPromotions<Us>(moves, forwardOne & promotionRow & checkMask, -forward, true, pinned);
 
-        if(p == empty && !capturesOnly) {
-            addQuietMove(moves, {
-                x,
-                y,
-                x + offsets[i][1],
-                y + offsets[i][0]
-            });
-        }
-        else if(pieceColours[p] == -turn) {
-            addCaptureMove(moves, {
-                x,
-                y,
-                x + offsets[i][1],
-                y + offsets[i][0]
-            }, piece, p);
-        }
+        generateEnPassantMoves<Us>(moves);
+    }
+
+    if(genType != GEN_CAPTURES) {
+        const bitboard forwardTwo = pawnPushes<Us>(forwardOne) & ~currentState.occupied & doublePushRow;
+
+        addPushPromotions<Us>(moves, forwardOne & promotionRow & checkMask, -forward, false, pinned);
+        addPawnMoves<Us>(moves, forwardOne & ~promotionRow & checkMask, -forward, false, pinned);
+        addPawnMoves<Us>(moves, forwardTwo & checkMask, -2 * forward, false, pinned);
     }
 }
 
-void Game::generateBishopMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly) {
-    const Colour turn = currentState.turn;
+template<Colour Us>
+void Game::generateEnPassantMoves(move_list& moves) {
+    if(currentState.enPass == NO_EN_PASS) {
+        return;
+    }
 
-    Piece piece = PIECE_AT(y, x);
+    const Colour Them = Us == WHITE ? BLACK : WHITE;
+    const int enPass = currentState.enPass;
+    const int capturedSq = Us == WHITE ? enPass + 8 : enPass - 8;
+    const int kingSq = currentState.kingSquare[COLOUR_INDEX(Us)];
+    const bitboard enemySliders = currentState.colourBB[COLOUR_INDEX(Them)] & ~SQUARE_BB(capturedSq);
+    const bitboard queens = currentState.pieceBB[Queen];
 
-    int yDirsDiag[2] = { -1, 1 };
-    int xDirsDiag[2] = { -1, 1 };
+    bitboard attackers = attacks::pawnAttacks[COLOUR_INDEX(Them)][enPass] & currentState.pieceBB[Pawn] & currentState.colourBB[COLOUR_INDEX(Us)];
 
-    for(int i = 0; i < 2; ++i) {
-        for(int j = 0; j < 2; ++j) {
-            int searchDirY = yDirsDiag[i];
-            int searchDirX = xDirsDiag[j];
-            int searchY = y;    
-            int searchX = x;
+    while(attackers) {
+        const int from = popLsb(attackers);
 
-            while(true) {
-                searchX += searchDirX;
-                searchY += searchDirY;
-                Piece p = PIECE_AT(searchY, searchX);
+        //Two pieces leave their squares at once so test the resulting position directly. Any checker that
+        //is not a slider has to be the captured pawn.
+        const bitboard occupied = (currentState.occupied ^ SQUARE_BB(from) ^ SQUARE_BB(capturedSq)) | SQUARE_BB(enPass);
 
-                if(p == off_board || pieceColours[p] == turn) {
-                    break;
-                }
+        if(currentState.checkers & ~SQUARE_BB(capturedSq) & ~currentState.pieceBB[Bishop] & ~currentState.pieceBB[Rook] & ~queens) {
+            continue;
+        }
 
-                if(p == empty && !capturesOnly) {
-                    addQuietMove(moves, {
-                        x,
-                        y,
-                        (unsigned int)searchX,
-                        (unsigned int)searchY
-                    });
-                }
-                else if(pieceColours[p] == -turn) {
-                    addCaptureMove(moves, {
-                        x,
-                        y,
-                        (unsigned int)searchX,
-                        (unsigned int)searchY
-                    }, piece, p);
-                    break;
-                }
-            };
+        if((attacks::bishopAttacks(kingSq, occupied) & (currentState.pieceBB[Bishop] | queens) & enemySliders) ||
+            (attacks::rookAttacks(kingSq, occupied) & (currentState.pieceBB[Rook] | queens) & enemySliders)) {
+            continue;
         }
+
+        addCaptureMove(moves, createMove(from, enPass, MOVE_EN_PASSANT), MAKE_PIECE(Pawn, Us), MAKE_PIECE(Pawn, Them));
     }
 }
 
-void Game::generateRookMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly) {
-    const Colour turn = currentState.turn;
+template<Colour Us>
+void Game::generateKnightMoves(move_list& moves, const bitboard targets, const bitboard pinned) {
+    //A pinned knight can never stay on the pin line
+    bitboard knights = currentState.pieceBB[Knight] & currentState.colourBB[COLOUR_INDEX(Us)] & ~pinned;
 
-    Piece piece = PIECE_AT(y, x);
+    while(knights) {
+        const int from = popLsb(knights);
+        addMoves(moves, from, attacks::knightAttacks[from] & targets);
+    }
+}
 
-    int yDirsNonDiag[4] = { -1, 1, 0, 0 };
-    int xDirsNonDiag[4] = { 0, 0, -1, 1 };
-    for(int i = 0; i < 4; ++i) {
-        int searchDirY = yDirsNonDiag[i];
-        int searchDirX = xDirsNonDiag[i];
-        int searchY = y;
-        int searchX = x;
+template<Colour Us>
+void Game::generateBishopMoves(move_list& moves, const bitboard targets, const bitboard pinned) {
+    const int kingSq = currentState.kingSquare[COLOUR_INDEX(Us)];
 
-        while(true) {
-            searchX += searchDirX;
-            searchY += searchDirY;
-            Piece p = PIECE_AT(searchY, searchX);
+    bitboard bishops = currentState.pieceBB[Bishop] & currentState.colourBB[COLOUR_INDEX(Us)];
 
-            if(p == off_board || pieceColours[p] == turn) {
-                break;
-            }
+    while(bishops) {
+        const int from = popLsb(bishops);
+        const bitboard pinMask = (pinned & SQUARE_BB(from)) ? attacks::line[kingSq][from] : ~0ULL;
 
-            if(p == empty && !capturesOnly) {
-                addQuietMove(moves, {
-                    x,
-                    y,
-                    (unsigned int)searchX,
-                    (unsigned int)searchY
-                });
-            }
-            else if(pieceColours[p] == -turn) {
-                addCaptureMove(moves, {
-                    x,
-                    y,
-                    (unsigned int)searchX,
-                    (unsigned int)searchY
-                }, piece, p);
-                break;
-            }
-        };
+        addMoves(moves, from, attacks::bishopAttacks(from, currentState.occupied) & targets & pinMask);
     }
 }
 
-void Game::generateQueenMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly) {
-    generateBishopMoves(moves, x, y, capturesOnly);
-    generateRookMoves(moves, x, y, capturesOnly);
-}
+template<Colour Us>
+void Game::generateRookMoves(move_list& moves, const bitboard targets, const bitboard pinned) {
+    const int kingSq = currentState.kingSquare[COLOUR_INDEX(Us)];
 
-void Game::generateKingMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly) {
-    const Colour turn = currentState.turn;
+    bitboard rooks = currentState.pieceBB[Rook] & currentState.colourBB[COLOUR_INDEX(Us)];
 
-    Piece piece = PIECE_AT(y, x);
+    while(rooks) {
+        const int from = popLsb(rooks);
+        const bitboard pinMask = (pinned & SQUARE_BB(from)) ? attacks::line[kingSq][from] : ~0ULL;
 
-    const int offsets[8][2] = {
-        { -1,  0 },
-        { -1, -1 },
-        {  0, -1 },
-        {  1, -1 },
-        {  1,  0 },
-        {  1,  1 },
-        {  0,  1 },
-        { -1,  1 }
-    };
+        addMoves(moves, from, attacks::rookAttacks(from, currentState.occupied) & targets & pinMask);
+    }
+}
 
-    for(int i = 0; i < 8; ++i) {
-        Piece p = PIECE_AT(y + offsets[i][1], x + offsets[i][0]);
-
-        if(p == empty && !capturesOnly && !isAttacked(x + offsets[i][0], y + offsets[i][1], (Colour)-turn)) {
-            addQuietMove(moves, {
-                x,
-                y,
-                x + offsets[i][0],
-                y + offsets[i][1]
-            });
-        }
-        else if(p != off_board && pieceColours[p] == -turn && !isAttacked(x + offsets[i][0], y + offsets[i][1], (Colour)-turn)) {
-            ASSERT(p != empty);
-
-            addCaptureMove(moves, {
-                x,
-                y,
-                x + offsets[i][0],
-                y + offsets[i][1]    
-            }, piece, p);
-        }
-    }
-
-    if(!capturesOnly) {
-        //Castling
-        if(turn == WHITE) {
-            if(currentState.castlePerm & K) {
-                unsigned int pathPositions[3][2] = {
-                    { 7, 4 },
-                    { 7, 5 },
-                    { 7, 6 }
-                };
-
-                bool canCastle = true;
-                
-                for(int i = 0; i < 3; ++i) {
-                    Piece p = PIECE_AT(pathPositions[i][0], pathPositions[i][1]);
-                    
-                    if((i != 0 && p != empty) || isAttacked(pathPositions[i][1], pathPositions[i][0], (Colour)-turn)) {
-                        canCastle = false;
-                        break;
-                    }
-                }
+template<Colour Us>
+void Game::generateQueenMoves(move_list& moves, const bitboard targets, const bitboard pinned) {
+    const int kingSq = currentState.kingSquare[COLOUR_INDEX(Us)];
 
-                if(canCastle) {
-                    addQuietMove(moves, {
-                        x,
-                        y,
-                        6,
-                        7
-                    });
-                }
-            }
+    bitboard queens = currentState.pieceBB[Queen] & currentState.colourBB[COLOUR_INDEX(Us)];
 
-            if((currentState.castlePerm & Q) >> 1) {
-                unsigned int pathPositions[4][2] = {
-                    { 7, 4 },
-                    { 7, 3 },
-                    { 7, 2 },
-                    { 7, 1 },
-                };
+    while(queens) {
+        const int from = popLsb(queens);
+        const bitboard pinMask = (pinned & SQUARE_BB(from)) ? attacks::line[kingSq][from] : ~0ULL;
 
-                bool canCastle = true;
+        addMoves(moves, from, attacks::queenAttacks(from, currentState.occupied) & targets & pinMask);
+    }
+}
 
-                for(int i = 1; i < 4; ++i) {
-                    Piece p = PIECE_AT(pathPositions[i][0], pathPositions[i][1]);
+template<Colour Us>
+void Game::generateKingMoves(move_list& moves, MoveGenType genType) {
+    const Colour Them = Us == WHITE ? BLACK : WHITE;
+    const int from = currentState.kingSquare[COLOUR_INDEX(Us)];
 
-                    if(p != empty) {
-                        canCastle = false;
-                        break;
-                    }
-                }
+    //The king is taken off the board so it cannot hide behind itself from a slider it is moving away from
+    const bitboard occupied = currentState.occupied ^ SQUARE_BB(from);
+    const bitboard enemies = currentState.colourBB[COLOUR_INDEX(Them)];
 
-                if(canCastle) {
-                    for(int i = 0; i < 3; ++i) {
-                        if(isAttacked(pathPositions[i][1], pathPositions[i][0], (Colour)-turn)) {
-                            canCastle = false;
-                        }
-                    }
-
-                    if(canCastle) {
-                        addQuietMove(moves, {
-                            x,
-                            y,
-                            2,
-                            7
-                        });
-                    }
-                }
-            }
-        }
-        else {
-            if((currentState.castlePerm & k) >> 2) {
-                unsigned int pathPositions[3][2] = {
-                    { 0, 4 },
-                    { 0, 5 },
-                    { 0, 6 }
-                };
-
-                bool canCastle = true;
-                
-                for(int i = 0; i < 3; ++i) {
-                    Piece p = PIECE_AT(pathPositions[i][0], pathPositions[i][1]);
-                    
-                    if((i != 0 && p != empty) || isAttacked(pathPositions[i][1], pathPositions[i][0], (Colour)-turn)) {
-                        canCastle = false;
-                        break;
-                    }
-                }
+    bitboard targets = attacks::kingAttacks[from] & moveTargets<Us>(currentState, genType);
 
-                if(canCastle) {
-                    addQuietMove(moves, {
-                        x,
-                        y,
-                        6,
-                        0
-                    });
-                }
-            }
+    while(targets) {
+        const int to = popLsb(targets);
 
-            if((currentState.castlePerm & q) >> 3) {
-                unsigned int pathPositions[4][2] = {
-                    { 0, 4 },
-                    { 0, 3 },
-                    { 0, 2 },
-                    { 0, 1 },
-                };
+        if(!(attackersTo(to, occupied) & enemies)) {
+            addMoves(moves, from, SQUARE_BB(to));
+        }
+    }
 
-                bool canCastle = true;
+    if(genType != GEN_CAPTURES && !currentState.checkers) {
+        //Castling. The king may not start on, pass through or land on an attacked square.
+        const int row = Us == WHITE ? 7 : 0;
+        const unsigned int kingSidePerm = Us == WHITE ? K : k;
+        const unsigned int queenSidePerm = Us == WHITE ? Q : q;
 
-                for(int i = 1; i < 4; ++i) {
-                    Piece p = PIECE_AT(pathPositions[i][0], pathPositions[i][1]);
+        if(currentState.castlePerm & kingSidePerm) {
+            const bitboard path = SQUARE_BB(SQUARE(row, 5)) | SQUARE_BB(SQUARE(row, 6));
 
-                    if(p != empty) {
-                        canCastle = false;
-                        break;
-                    }
-                }
+            if(!(currentState.occupied & path) &&
+                !isAttacked(SQUARE(row, 5), Them) &&
+                !isAttacked(SQUARE(row, 6), Them)) {
+                addQuietMove(moves, createMove(from, SQUARE(row, 6), MOVE_CASTLING));
+            }
+        }
 
-                if(canCastle) {
-                    for(int i = 0; i < 3; ++i) {
-                        if(isAttacked(pathPositions[i][1], pathPositions[i][0], (Colour)-turn)) {
-                            canCastle = false;
-                        }
-                    }
-
-                    if(canCastle) {
-                        addQuietMove(moves, {
-                            x,
-                            y,
-                            2,
-                            0
-                        });
-                    }
-                }
+        if(currentState.castlePerm & queenSidePerm) {
+            const bitboard path = SQUARE_BB(SQUARE(row, 1)) | SQUARE_BB(SQUARE(row, 2)) | SQUARE_BB(SQUARE(row, 3));
+
+            if(!(currentState.occupied & path) &&
+                !isAttacked(SQUARE(row, 3), Them) &&
+                !isAttacked(SQUARE(row, 2), Them)) {
+                addQuietMove(moves, createMove(from, SQUARE(row, 2), MOVE_CASTLING));
             }
         }
     }
@@ -977,46 +1044,19 @@ void Game::print() {
     printf("\n   a b c d e f g h\n");
     printf("\n");
     printf("Turn: %s\n", currentState.turn == WHITE ? "WHITE" : "BLACK");
-    // printf("Fifty: %d\n", fiftyMove);
-    printf("En-passant: %d, %d\n", currentState.enPass.x, currentState.enPass.y);
+    printf("Fifty: %d\n", currentState.fiftyMove);
+    printf("En-passant: %d, %d\n", COL_OF(currentState.enPass), ROW_OF(currentState.enPass));
     printf("Castling: K:%d Q:%d k:%d q:%d\n", (currentState.castlePerm & K), (currentState.castlePerm & Q) >> 1, (currentState.castlePerm & k) >> 2, (currentState.castlePerm & q) >> 3);
     printf("Hash code: %llu\n", currentState.hashCode);
     printf("\n");
 }
 
 int Game::currentBoardValue() {
-    int value = 0;
-
-    for(int i = 0; i < 8; ++i) {
-        for(int j = 0; j < 8; ++j) {
-            Piece p = PIECE_AT(i, j);
-
-            switch(p) {
-                case bP: 
-                case wP:                 
-                    value += 100;    
-                    break;
-                case bN: 
-                case wN:                 
-                    value += 320; 
-                    break;
-                case bB: 
-                case wB:                 
-                    value += 330; 
-                    break;
-                case bR: 
-                case wR:                 
-                    value += 500; 
-                    break;
-                case bQ: 
-                case wQ:                 
-                    value += 900; 
-                    break;
-                default: 
-                    break;
-            }
-        }
-    }
+    const int* counts = currentState.pieceCounts;
 
-    return value;
+    return (counts[bP] + counts[wP]) * 100 +
+        (counts[bN] + counts[wN]) * 320 +
+        (counts[bB] + counts[wB]) * 330 +
+        (counts[bR] + counts[wR]) * 500 +
+        (counts[bQ] + counts[wQ]) * 900;
 }
\ No newline at end of file
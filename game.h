@@ -6,9 +6,15 @@
 #include <vector>
 #include <climits>
 
+#include "bitboard.h"
 #include "debug.h"
+#include "nnue.h"
 
 #define STARTPOS "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+//math.h defines INFINITY as a float, scores use their own integer version
+#ifdef INFINITY
+#undef INFINITY
+#endif
 #define INFINITY (INT_MAX - 1000)
 
 enum Colour {
@@ -52,99 +58,158 @@ enum CastlePerm {
     q = 8
 };
 
-struct enPassLocation {
-    unsigned int x : 3;
-    unsigned int y : 3;
-
-    void set(unsigned int i) {
-        this->x = (0x38 & i) >> 3;
-        this->y = ( 0x7 & i);
-    }
-
-    enPassLocation(unsigned int i) {
-        this->set(i);
-    }
-
-    enPassLocation operator=(unsigned int i) {
-        this->set(i);
-        return *this;
-    }
-
-    operator unsigned int() {
-        return (x << 3) + y;
-    }
+enum GameStage {
+    MIDDLEGAME = 0,
+    ENDGAME
 };
 
 #define NO_EN_PASS 0
-#define EN_PASS(x, y) (((0x7 & x) << 3) + (0x7 & y))
+#define MAX_FIFTY_MOVE 255
+#define MAX_PHASE 24
+
+#define COLOUR_INDEX(colour) ((colour) == WHITE ? 0 : 1)
+#define MAKE_PIECE(pieceType, colour) ((Piece)((pieceType) + ((colour) == WHITE ? 6 : 0)))
 
 struct gameState {
-    Piece board[12][12];
+    Piece board[64];
+    bitboard pieceBB[7];  //Indexed by PieceType, both colours
+    bitboard colourBB[2]; //Indexed by COLOUR_INDEX
+    bitboard occupied;
+    int kingSquare[2];    //Indexed by COLOUR_INDEX
+    int pieceCounts[13];  //Indexed by Piece
+    int material;         //Running sums of pieceMaterial, pieceSquareScores and piecePhases over the board
+    int pieceSquare[2];   //Indexed by GameStage
+    int phase;            //MAX_PHASE with all pieces on the board, down to 0 with only pawns and kings
     Colour turn = WHITE;
     unsigned int castlePerm : 4;
-    enPassLocation enPass = NO_EN_PASS;
-    int fiftyMove : 5;
+    unsigned int enPass = NO_EN_PASS; //Square behind a pawn that just moved two squares
+    int fiftyMove;        //Plies since the last pawn move or capture
     int turns : 8;
-    bool whiteInCheck;
-    bool blackInCheck;
+    bitboard checkers;    //Pieces giving check to the side to move
     unsigned long long hashCode;
+    unsigned long long pawnHashCode; //Hash of the pawns alone, keys the pawn structure table
+    nnue::accumulator accumulator;   //Only kept up to date when nnue::enabled
 };
 
-#define MOVE_SCORE_MAX  16382 //15 bits signed (and not overflowing when negated)
-#define MOVE_SCORE_MIN -16383 //15 bits signed (and not overflowing when negated)
+enum MoveFlag {
+    MOVE_NORMAL = 0,
+    MOVE_PROMOTION,
+    MOVE_EN_PASSANT,
+    MOVE_CASTLING
+};
 
+//16 bits: from square (bits 0-5), to square (bits 6-11), promotion piece minus Knight (bits 12-13), MoveFlag (bits 14-15)
 struct move {
-    unsigned int fromX  : 3;
-    unsigned int fromY  : 3;
-    unsigned int toX    : 3;
-    unsigned int toY    : 3;
-    PieceType promotion : 4;
-    int score           : 16;
-
-    bool operator==(const move& rhs) {
-        return fromX == rhs.fromX &&
-            fromY == rhs.fromY &&
-            toX == rhs.toX &&
-            toY == rhs.toY &&
-            promotion == rhs.promotion;
+    unsigned short data;
+
+    int from() const {
+        return data & 0x3F;
     }
 
-    bool operator!=(const move& rhs) {
-        return !(*this == rhs);
+    int to() const {
+        return (data >> 6) & 0x3F;
+    }
+
+    MoveFlag flag() const {
+        return (MoveFlag)(data >> 14);
+    }
+
+    PieceType promotion() const {
+        return flag() == MOVE_PROMOTION ? (PieceType)(((data >> 12) & 0x3) + Knight) : Empty;
+    }
+
+    bool operator==(const move& rhs) const {
+        return data == rhs.data;
+    }
+
+    bool operator!=(const move& rhs) const {
+        return data != rhs.data;
     }
 };
 
-#define NO_MOVE (move { 0, 0, 0, 0, Empty })
+#define NO_MOVE (move { 0 })
+
+enum MoveGenType {
+    GEN_ALL = 0,
+    GEN_CAPTURES,
+    GEN_QUIETS
+};
 
 struct move_list {
     //From what I can find, 208 is the maximum number of moves at any position in chess
     move moves[256];
+    int scores[256];
     int numMoves = 0;
 
-    void addMove(const move mv) {
+    void addMove(const move mv, const int score) {
+        scores[numMoves] = score;
         moves[numMoves++] = mv;
     }
 };
 
+//The undo records and keys are kept in a ring indexed by HISTORY_INDEX(ply). Only positions since the last
+//irreversible move can repeat and only the search ever undoes moves, so the ring holds MAX_FIFTY_MOVE plies
+//plus the deepest search line and older entries are simply overwritten. Must be a power of two.
+#define HISTORY_SIZE 512
+#define HISTORY_INDEX(i) ((i) & (HISTORY_SIZE - 1))
+
+//Everything makeMove destroys that undoLastMove cannot work out from the move itself
+//The hash code is kept in Game::keyHistory instead
+struct undo_record {
+    unsigned long long pawnHashCode;
+    ::move move;
+    unsigned char capturedPiece;
+    unsigned char castlePerm;
+    unsigned char enPass;
+    unsigned char fiftyMove;
+    bitboard checkers;
+};
+
 class Game {
 public:
     gameState currentState;
-    std::vector<gameState> stateHistory;
+    undo_record history[HISTORY_SIZE];
+    //Hash code of the position before each move in history. Kept apart from the undo records so repetition
+    //checks read a few cache lines of keys and nothing else.
+    unsigned long long keyHistory[HISTORY_SIZE];
+    int historyLength = 0; //Plies played since startPosition, not bounded by the ring
     void startPosition(const std::string& fen);
     void makeMove(const move& move);
     void undoLastMove();
-    const bool isAttacked(unsigned int x, unsigned int y, const Colour attackingColour);
+    void makeNullMove();
+    void undoNullMove();
+    const bool hasNonPawnMaterial(const Colour colour);
+    void putPiece(const Piece piece, const int sq);
+    void removePiece(const int sq);
+    void movePiece(const int from, const int to);
+    const bool isAttacked(const int sq, const Colour attackingColour);
+    const bitboard attackersTo(const int sq, const bitboard occupied);
+    const bitboard pinnedPieces(const Colour colour);
+    const bool isCapture(const move& m);
+    const int captureGain(const move& m);
+    const int staticExchange(const move& m);
+    const bool isLegalMove(const move& m);
     void addQuietMove(move_list& moves, move move);
     void addCaptureMove(move_list& moves, move move, const Piece pieceMoved, const Piece capturedPiece);
-    void generateMoves(move_list& moves, bool capturesOnly);
-    void generatePawnMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly);
-    void generateKnightMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly);
-    void generateBishopMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly);
-    void generateRookMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly);
-    void generateQueenMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly);
-    void generateKingMoves(move_list& moves, unsigned int x, unsigned int y, bool capturesOnly);
+    void addMoves(move_list& moves, const int from, bitboard targets);
+    void generateMoves(move_list& moves, MoveGenType genType);
     void print();
     int currentBoardValue();
+private:
+    //Specialised per side to move so colour dependent directions, rows and pieces are compile time constants.
+    //The public functions above dispatch on currentState.turn once.
+    template<Colour Us> void makeMove(const move& move);
+    template<Colour Us> void undoLastMove();
+    template<Colour Us> void addPawnMoves(move_list& moves, bitboard targets, const int fromOffset, const bool isCapture, const bitboard pinned);
+    template<Colour Us> void addPushPromotions(move_list& moves, bitboard targets, const int fromOffset, const bool queen, const bitboard pinned);
+    template<Colour Us> void generateMoves(move_list& moves, MoveGenType genType);
+    template<Colour Us> void generatePawnMoves(move_list& moves, MoveGenType genType, const bitboard checkMask, const bitboard pinned);
+    template<Colour Us> void generateEnPassantMoves(move_list& moves);
+    template<Colour Us> void generateKnightMoves(move_list& moves, const bitboard targets, const bitboard pinned);
+    template<Colour Us> void generateBishopMoves(move_list& moves, const bitboard targets, const bitboard pinned);
+    template<Colour Us> void generateRookMoves(move_list& moves, const bitboard targets, const bitboard pinned);
+    template<Colour Us> void generateQueenMoves(move_list& moves, const bitboard targets, const bitboard pinned);
+    template<Colour Us> void generateKingMoves(move_list& moves, MoveGenType genType);
 };
 
 #endif
\ No newline at end of file
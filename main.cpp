@@ -2,19 +2,36 @@
 #include <iterator>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <chrono>
 
 #include "game.h"
 #include "zobrist.h"
+#include "attacks.h"
+#include "evaluation.h"
 #include "pvtable.h"
+#include "pawntable.h"
+#include "evalcache.h"
+#include "statistics.h"
 #include "search.h"
 #include "utils.h"
 #include "perft.h"
 #include "debug.h"
 #include "tcpsocket.h"
 
-#define PV_TABLE_SIZE (1024 * 1024 * 2023)
+#define DEFAULT_HASH_MB 2023
+#define MAX_HASH_MB (1024 * 64)
+#define PAWN_TABLE_SIZE (1024 * 1024 * 2)
+#define DEFAULT_EVAL_CACHE_MB 16
+#define MAX_EVAL_CACHE_MB 1024
 #define MAX_SEARCH_DEPTH 64
+#define MAX_THREADS 64
+#define BENCH_DEPTH 12
+//Aspiration windows start this far either side of the last iteration's score and double on each failure,
+//the window is fully opened once it would reach ASPIRATION_MAX_WINDOW
+#define ASPIRATION_MIN_DEPTH 5
+#define ASPIRATION_WINDOW 25
+#define ASPIRATION_MAX_WINDOW 1000
 
 Game* game = new Game();
 std::mutex game_state_m;
@@ -28,25 +45,104 @@ volatile bool stopPonder = false;
 
 int movesToGo = 60; //default number of moves estimated for a game
 
+int numThreads = 1;
+
+//Cleared when the last position command held a move that couldn't be played, the game then isn't the GUI's
+bool positionValid = true;
+
+//Lazy SMP helper. Helpers fill the shared pv table for the main thread. Each one skips depths in runs of
+//skipSize iterations offset by skipPhase, picked by its id, so no two helpers and no helper and the main
+//thread walk the same tree in lock step. The pattern repeats after HELPER_SKIP_PATTERNS helpers.
+#define HELPER_SKIP_PATTERNS 20
+
+static const int skipSize[HELPER_SKIP_PATTERNS] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+static const int skipPhase[HELPER_SKIP_PATTERNS] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+void helperSearch(search_thread* thread, volatile bool* stop) {
+    counter_registration counters;
+    const int pattern = (thread->id - 1) % HELPER_SKIP_PATTERNS;
+
+    for(int depth = 1; depth <= MAX_SEARCH_DEPTH; ++depth) {
+        if(*stop) {
+            break;
+        }
+
+        if(((depth + skipPhase[pattern]) / skipSize[pattern]) % 2) {
+            continue;
+        }
+
+        move m;
+        alphaBeta(thread, m, depth, -INFINITY, INFINITY, 1, stop);
+    }
+}
+
 void search(move* bestMove) {
     std::lock_guard<std::mutex> gameStateLock(game_state_m);
+    counter_registration counters;
+
+    std::vector<search_thread*> threads;
+    std::vector<std::thread> helpers;
+    volatile bool stopHelpers = false;
+
+    for(int i = 0; i < numThreads; ++i) {
+        threads.push_back(new search_thread{ *game, i });
+    }
+
+    for(int i = 1; i < numThreads; ++i) {
+        helpers.push_back(std::thread(helperSearch, threads[i], &stopHelpers));
+    }
+
+    search_thread* mainThread = threads[0];
+    int previousScore = 0;
 
     for(int depth = 1; depth <= MAX_SEARCH_DEPTH; ++depth) {
         if(stopSearch) {
             break;
         }
 
+        //Search a narrow window around the previous score first, mate scores are too far apart to guess
+        int delta = ASPIRATION_WINDOW;
+        int alpha = -INFINITY;
+        int beta = INFINITY;
+
+        if(depth >= ASPIRATION_MIN_DEPTH && std::abs(previousScore) < MATE_SCORE) {
+            alpha = previousScore - delta;
+            beta = previousScore + delta;
+        }
+
         move m;
-        int score = alphaBeta(game, m, depth, -INFINITY, INFINITY, 1, &stopSearch);      
+        int score;
+
+        while(true) {
+            score = alphaBeta(mainThread, m, depth, alpha, beta, 1, &stopSearch);
+
+            if(stopSearch) {
+                break;
+            }
+
+            if(score <= alpha && alpha > -INFINITY) {
+                alpha = delta >= ASPIRATION_MAX_WINDOW ? -INFINITY : score - delta;
+            }
+            else if(score >= beta && beta < INFINITY) {
+                beta = delta >= ASPIRATION_MAX_WINDOW ? INFINITY : score + delta;
+            }
+            else {
+                break;
+            }
+
+            delta *= 2;
+        }
+
+        previousScore = score;
 
         if(!stopSearch) {
-            std::cout << "info depth " << depth << " score cp " << ((float)score/1.0) << " pv";
+            std::cout << "info depth " << depth << " score cp " << ((float)score/1.0) << " hashfull " << pvTableFull() << " pv";
 
             LOG(std::string("info depth ") + std::to_string(depth) + " score cp " + std::to_string(((float)score/1.0)) + " pv");
 
             std::vector<move> pvMoves;
             
-            getPvLine(game, pvMoves, depth);
+            getPvLine(&mainThread->game, pvMoves, depth);
 
             for(auto it = pvMoves.begin(); it != pvMoves.end(); ++it) {
                 std::cout << " " << getMoveStr(*it);
@@ -57,6 +153,16 @@ void search(move* bestMove) {
         }
     }
 
+    stopHelpers = true;
+
+    for(auto it = helpers.begin(); it != helpers.end(); ++it) {
+        it->join();
+    }
+
+    for(auto it = threads.begin(); it != threads.end(); ++it) {
+        delete *it;
+    }
+
     std::lock_guard<std::mutex> searchDoneLock(search_done_m);
     searchDone = true;
     search_done_cond.notify_all();
@@ -64,6 +170,9 @@ void search(move* bestMove) {
 
 void ponder() {
     std::lock_guard<std::mutex> gameStateLock(game_state_m);
+    counter_registration counters;
+
+    search_thread* thread = new search_thread{ *game, 0 };
 
     for(int depth = 1; depth <= MAX_SEARCH_DEPTH; ++depth) {
         if(stopPonder) {
@@ -71,8 +180,10 @@ void ponder() {
         }
 
         move m;
-        alphaBeta(game, m, depth, -INFINITY, INFINITY, 1, &stopPonder);
+        alphaBeta(thread, m, depth, -INFINITY, INFINITY, 1, &stopPonder);
     }
+
+    delete thread;
 }
 
 void go(int timeInMs, move& moveMade) {
@@ -87,6 +198,8 @@ void go(int timeInMs, move& moveMade) {
     stopSearch = false;
     searchDone = false;
 
+    newPvSearch();
+
     std::thread searchThread(search, &bestMove);
 
     long long start = getCurrentTimeInMs();
@@ -136,14 +249,28 @@ void position(const std::string& input) {
         game->startPosition(input.substr(13, movesStart - 1));
     }
 
+    positionValid = true;
+
     for(auto it = moves.begin(); it != moves.end(); ++it) {
-        game->makeMove(getMove(*it));
+        move m = getMove(game, *it);
+
+        if(m == NO_MOVE) {
+            std::cout << "info string Illegal move " << *it << " in position command" << std::endl;
+            positionValid = false;
+            break;
+        }
+
+        game->makeMove(m);
     }
 }
 
 void uci() {
     std::cout << "id name TestEngine" << std::endl;
     std::cout << "id author Michael Claassen" << std::endl;
+    std::cout << "option name Hash type spin default " << DEFAULT_HASH_MB << " min 1 max " << MAX_HASH_MB << std::endl;
+    std::cout << "option name Clear Hash type button" << std::endl;
+    std::cout << "option name EvalCache type spin default " << DEFAULT_EVAL_CACHE_MB << " min 1 max " << MAX_EVAL_CACHE_MB << std::endl;
+    std::cout << "option name Threads type spin default 1 min 1 max " << MAX_THREADS << std::endl;
     std::cout << "uciok" << std::endl;
 
     std::string input;
@@ -162,6 +289,7 @@ void uci() {
             stopPonder = true;
             {
                 std::lock_guard<std::mutex> lock(game_state_m);
+                clearPvTable();
             }
             delete game;
             game = new Game();
@@ -174,6 +302,12 @@ void uci() {
         }
         else if(input.substr(0, 2).compare("go") == 0) {
             //go wtime 300000 btime 300000 [movestogo 50]
+            if(!positionValid) {
+                std::cout << "info string Not searching, the last position command was invalid" << std::endl;
+                std::cout << "bestmove 0000" << std::endl;
+                continue;
+            }
+
             std::vector<std::string> parts;
             split(input, parts);
 
@@ -203,6 +337,39 @@ void uci() {
         else if(input.compare("stop") == 0) {
             stopSearch = true;
         }
+        else if(input.substr(0, 9).compare("setoption") == 0) {
+            //setoption name <name> value <value>
+            std::vector<std::string> parts;
+            split(input, parts);
+
+            if(parts.size() > 4 && parts[2].compare("Threads") == 0) {
+                numThreads = std::min(MAX_THREADS, std::max(1, std::stoi(parts[4])));
+            }
+            else if(parts.size() > 4 && parts[2].compare("Hash") == 0) {
+                stopPonder = true;
+                std::lock_guard<std::mutex> lock(game_state_m);
+                const int hashMb = std::min(MAX_HASH_MB, std::max(1, std::stoi(parts[4])));
+
+                if(!initPvTable(hashMb)) {
+                    std::cout << "info string Could not allocate " << hashMb << "MB for the hash table, keeping the old one" << std::endl;
+                }
+            }
+            else if(parts.size() > 4 && parts[2].compare("EvalCache") == 0) {
+                stopPonder = true;
+                std::lock_guard<std::mutex> lock(game_state_m);
+                const int evalCacheMb = std::min(MAX_EVAL_CACHE_MB, std::max(1, std::stoi(parts[4])));
+
+                if(!initEvalCache(evalCacheMb)) {
+                    std::cout << "info string Could not allocate " << evalCacheMb << "MB for the eval cache, keeping the old one" << std::endl;
+                }
+            }
+            else if(parts.size() > 3 && parts[2].compare("Clear") == 0 && parts[3].compare("Hash") == 0) {
+                stopPonder = true;
+                std::lock_guard<std::mutex> lock(game_state_m);
+                clearPvTable();
+                clearEvalCache();
+            }
+        }
 
         //TODO: quit
     }
@@ -255,6 +422,7 @@ void tb() {
             stopPonder = true;
             {
                 std::lock_guard<std::mutex> lock(game_state_m);
+                clearPvTable();
             }
             delete game;
             game = new Game();
@@ -299,12 +467,72 @@ void tb() {
     }
 }
 
+//Fixed depth searches of a few positions on an empty table, for comparing the speed of builds
+void bench(int depth) {
+    counter_registration counters;
+    const char* fens[] = {
+        STARTPOS,
+        "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1"
+    };
+
+    stopPonder = true;
+    std::lock_guard<std::mutex> lock(game_state_m);
+    volatile bool stop = false;
+
+    clearPvTable();
+    clearEvalCache();
+
+    unsigned long long totalNodes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for(auto fen : fens) {
+        search_thread* thread = new search_thread{ Game(), 0 };
+        thread->game.startPosition(fen);
+        newPvSearch();
+
+        move m;
+        int score = 0;
+
+        for(int d = 1; d <= depth; ++d) {
+            score = alphaBeta(thread, m, d, -INFINITY, INFINITY, 1, &stop);
+        }
+
+        std::cout << fen << ": " << getMoveStr(m) << " score " << score << " nodes " << thread->nodes << std::endl;
+        totalNodes += thread->nodes;
+
+        delete thread;
+    }
+
+    const long long ms = std::max(1LL, (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    std::cout << "Nodes: " << totalNodes << std::endl;
+    std::cout << "Time: " << ms << "ms" << std::endl;
+    std::cout << "NPS: " << totalNodes * 1000 / ms << std::endl;
+}
+
 int main(int argc, char *argv[]) {
     std::cout.setf(std::ios::unitbuf);
     std::cin.setf(std::ios::unitbuf);
     // signal(SIGINT, SIG_IGN);
     zobrist::initialize();
-    initPvTable(PV_TABLE_SIZE);
+    attacks::initialize();
+    initEvaluation();
+    initSearch();
+    if(!initPvTable(DEFAULT_HASH_MB)) {
+        std::cout << "Failed to allocate pv table" << std::endl;
+        return 1;
+    }
+    initPawnTable(PAWN_TABLE_SIZE);
+    initEvalCache(DEFAULT_EVAL_CACHE_MB);
+
+    //testengine -nnue <file> evaluates with the network instead of the hand written evaluation
+    if(argc > 2 && std::string(argv[1]).compare("-nnue") == 0) {
+        nnue::load(argv[2]);
+    }
 
     INIT_LOGGING();
 
@@ -329,12 +557,22 @@ int main(int argc, char *argv[]) {
         else if(input.compare("p") == 0) {
             game->print();
         }
+        else if(input.substr(0, 5).compare("bench") == 0) {
+            //bench [depth]
+            bench(input.size() > 6 ? std::stoi(input.substr(6)) : BENCH_DEPTH);
+        }
         else if(input.compare("stats") == 0) {
             printPvStatistics();
+            printPawnTableStatistics();
+            printEvalCacheStatistics();
         }
         else if(input.substr(0, 4).compare("move") == 0) {
             std::string moveStr = input.substr(5);
-            game->makeMove(getMove(moveStr));
+            move m = getMove(game, moveStr);
+
+            if(m != NO_MOVE) {
+                game->makeMove(m);
+            }
         }
     }
 }
\ No newline at end of file
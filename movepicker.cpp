@@ -0,0 +1,161 @@
+#include <algorithm>
+
+#include "movepicker.h"
+
+MovePicker::MovePicker(Game* game, const move& ttMove, bool capturesOnly, const move* killers, const int (*history)[64]) {
+    this->game = game;
+    this->capturesOnly = capturesOnly;
+    this->history = history;
+    this->stage = STAGE_TT_MOVE;
+    this->current = 0;
+
+    //The table move is only trusted once it is known to be legal here, since different positions can share a slot.
+    //Quiescence only ever plays captures and queen promotions, and like the others it has to not lose material.
+    if(ttMove != NO_MOVE && game->isLegalMove(ttMove) &&
+        (!capturesOnly || ((game->isCapture(ttMove) || ttMove.promotion() == Queen) && game->staticExchange(ttMove) >= 0))) {
+        this->ttMove = ttMove;
+    }
+    else {
+        this->ttMove = NO_MOVE;
+    }
+
+    //Killers come from sibling positions so they are checked the same way. A killer that is now a capture
+    //has already been tried with the captures.
+    for(int i = 0; i < 2; ++i) {
+        const bool usable = killers != nullptr && killers[i] != NO_MOVE && killers[i] != this->ttMove &&
+            game->isLegalMove(killers[i]) && !game->isCapture(killers[i]);
+
+        this->killers[i] = usable ? killers[i] : NO_MOVE;
+    }
+}
+
+//Selection step, swaps the highest scoring remaining move to the front
+move MovePicker::pickBest() {
+    int best = current;
+
+    for(int i = current + 1; i < moves.numMoves; ++i) {
+        if(moves.scores[i] > moves.scores[best]) {
+            best = i;
+        }
+    }
+
+    std::swap(moves.moves[current], moves.moves[best]);
+    std::swap(moves.scores[current], moves.scores[best]);
+
+    return moves.moves[current++];
+}
+
+//Captures are ordered by static exchange, what they actually win, with the generator's MVV-LVA score breaking
+//ties. Losing captures are set aside for after the quiet moves, or dropped in quiescence.
+void MovePicker::scoreCaptures() {
+    int kept = 0;
+
+    for(int i = 0; i < moves.numMoves; ++i) {
+        const move m = moves.moves[i];
+
+        if(m == ttMove) {
+            continue;
+        }
+
+        const int see = game->staticExchange(m);
+
+        if(see < 0) {
+            if(!capturesOnly) {
+                badCaptures.addMove(m, see);
+            }
+
+            continue;
+        }
+
+        moves.moves[kept] = m;
+        moves.scores[kept++] = see * CAPTURE_SEE_WEIGHT + moves.scores[i];
+    }
+
+    moves.numMoves = kept;
+}
+
+//Quiet moves are ordered by how often they caused a cutoff elsewhere in the tree. The only promotions left
+//here are under-promotions, a knight can fork or check where the queen couldn't so it goes before every
+//other quiet move, bishops and rooks do nothing a queen wouldn't do better so they go after.
+void MovePicker::scoreQuiets() {
+    for(int i = 0; i < moves.numMoves; ++i) {
+        const move m = moves.moves[i];
+
+        if(m.flag() == MOVE_PROMOTION) {
+            moves.scores[i] = m.promotion() == Knight ? QUIET_PROMOTION_BONUS : -QUIET_PROMOTION_BONUS;
+        }
+        else {
+            moves.scores[i] = history != nullptr ? history[m.from()][m.to()] : 0;
+        }
+    }
+}
+
+//Returns NO_MOVE once every move has been handed out
+move MovePicker::nextMove() {
+    switch(stage) {
+        case STAGE_TT_MOVE:
+            stage = STAGE_GENERATE_CAPTURES;
+
+            if(ttMove != NO_MOVE) {
+                return ttMove;
+            }
+            //fall through
+        case STAGE_GENERATE_CAPTURES:
+            game->generateMoves(moves, GEN_CAPTURES);
+            scoreCaptures();
+            stage = STAGE_CAPTURES;
+            //fall through
+        case STAGE_CAPTURES:
+            if(current < moves.numMoves) {
+                return pickBest();
+            }
+
+            if(capturesOnly) {
+                stage = STAGE_DONE;
+                return NO_MOVE;
+            }
+
+            stage = STAGE_KILLERS;
+            current = 0;
+            //fall through
+        case STAGE_KILLERS:
+            while(current < 2) {
+                move m = killers[current++];
+
+                if(m != NO_MOVE) {
+                    return m;
+                }
+            }
+
+            stage = STAGE_GENERATE_QUIETS;
+            //fall through
+        case STAGE_GENERATE_QUIETS:
+            moves.numMoves = 0;
+            current = 0;
+            game->generateMoves(moves, GEN_QUIETS);
+            scoreQuiets();
+            stage = STAGE_QUIETS;
+            //fall through
+        case STAGE_QUIETS:
+            while(current < moves.numMoves) {
+                move m = pickBest();
+
+                if(m != ttMove && m != killers[0] && m != killers[1]) {
+                    return m;
+                }
+            }
+
+            stage = STAGE_BAD_CAPTURES;
+            current = 0;
+            //fall through
+        case STAGE_BAD_CAPTURES:
+            if(current < badCaptures.numMoves) {
+                return badCaptures.moves[current++];
+            }
+
+            stage = STAGE_DONE;
+            //fall through
+        default:
+            return NO_MOVE;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef MOVEPICKER_H
+#define MOVEPICKER_H
+
+#include "game.h"
+
+//Static exchange scores are spread out by this so MVV-LVA (below 100) only orders captures that win the same
+#define CAPTURE_SEE_WEIGHT 128
+//Above any history score, which search.cpp keeps below about 1 << 20
+#define QUIET_PROMOTION_BONUS (1 << 24)
+
+enum PickerStage {
+    STAGE_TT_MOVE = 0,
+    STAGE_GENERATE_CAPTURES,
+    STAGE_CAPTURES,
+    STAGE_KILLERS,
+    STAGE_GENERATE_QUIETS,
+    STAGE_QUIETS,
+    STAGE_BAD_CAPTURES,
+    STAGE_DONE
+};
+
+//Hands out moves one at a time, best first, and only generates the next group of moves once the previous
+//group is used up. Most cut nodes fail high on the transposition table move or a capture, so quiet moves
+//are usually never generated. Captures that lose material by static exchange go last, and quiescence
+//drops them altogether.
+class MovePicker {
+private:
+    Game* game;
+    move ttMove;
+    move killers[2];
+    const int (*history)[64];
+    bool capturesOnly;
+    PickerStage stage;
+    move_list moves;
+    move_list badCaptures; //Captures that lose material, tried after the quiet moves
+    int current;
+
+    move pickBest();
+    void scoreCaptures();
+    void scoreQuiets();
+public:
+    //Killers and history are only used to order quiet moves, quiescence passes neither
+    MovePicker(Game* game, const move& ttMove, bool capturesOnly, const move* killers = nullptr, const int (*history)[64] = nullptr);
+    move nextMove();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "nnue.h"
+#include "game.h"
+#include "search.h"
+
+namespace nnue {
+    //Clipped ReLU ceiling of the hidden layer and scale of the output weights, the network output
+    //is multiplied by OUTPUT_SCALE to bring it to centipawns
+    #define QA 255
+    #define QB 64
+    #define OUTPUT_SCALE 400
+
+    bool enabled = false;
+
+    alignas(32) static short featureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+    alignas(32) static short featureBiases[NNUE_HIDDEN];
+    alignas(32) static short outputWeights[2][NNUE_HIDDEN]; //[0] side to move, [1] other side
+    static int outputBias;
+
+    //Pieces are numbered as in game.h, bP..bK = 1..6 and wP..wK = 7..12. Seen from a side, its own pieces
+    //come first and the board is flipped for black so both sides share the weights.
+    static inline int featureIndex(const int perspective, const int piece, const int sq) {
+        const int pieceColour = piece > 6 ? 0 : 1;
+        const int type = piece > 6 ? piece - 7 : piece - 1;
+        const int relativeSq = perspective == 0 ? sq : sq ^ 56;
+
+        return ((pieceColour != perspective) * 6 + type) * 64 + relativeSq;
+    }
+
+    //Accumulators live inside heap allocated games, which C++11 doesn't over-align, so they are accessed
+    //unaligned. The weights are static and aligned.
+    //The build only assumes SSE2, which every x86-64 CPU has. The AVX2 kernels are compiled for AVX2 on their
+    //own and only picked at runtime when the CPU supports it.
+#if defined(__x86_64__) || defined(__i386__)
+    #define NNUE_AVX2
+
+    static bool detectAvx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+
+    static const bool useAvx2 = detectAvx2();
+
+    __attribute__((target("avx2"))) static void addWeightsAvx2(short* values, const short* weights) {
+        for(int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+            v = _mm256_add_epi16(v, _mm256_load_si256((const __m256i*)(weights + i)));
+            _mm256_storeu_si256((__m256i*)(values + i), v);
+        }
+    }
+
+    __attribute__((target("avx2"))) static void subWeightsAvx2(short* values, const short* weights) {
+        for(int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+            v = _mm256_sub_epi16(v, _mm256_load_si256((const __m256i*)(weights + i)));
+            _mm256_storeu_si256((__m256i*)(values + i), v);
+        }
+    }
+
+    __attribute__((target("avx2"))) static int clippedDotAvx2(const short* values, const short* weights) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ceiling = _mm256_set1_epi16(QA);
+        __m256i sum = _mm256_setzero_si256();
+
+        for(int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+            v = _mm256_min_epi16(_mm256_max_epi16(v, zero), ceiling);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, _mm256_load_si256((const __m256i*)(weights + i))));
+        }
+
+        __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        total = _mm_add_epi32(total, _mm_shuffle_epi32(total, _MM_SHUFFLE(1, 0, 3, 2)));
+        total = _mm_add_epi32(total, _mm_shuffle_epi32(total, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(total);
+    }
+#endif
+
+    static inline void addWeights(short* values, const short* weights) {
+#if defined(NNUE_AVX2)
+        if(useAvx2) {
+            addWeightsAvx2(values, weights);
+            return;
+        }
+#endif
+#if defined(__SSE2__)
+        for(int i = 0; i < NNUE_HIDDEN; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+            v = _mm_add_epi16(v, _mm_load_si128((const __m128i*)(weights + i)));
+            _mm_storeu_si128((__m128i*)(values + i), v);
+        }
+#else
+        for(int i = 0; i < NNUE_HIDDEN; ++i) {
+            values[i] += weights[i];
+        }
+#endif
+    }
+
+    static inline void subWeights(short* values, const short* weights) {
+#if defined(NNUE_AVX2)
+        if(useAvx2) {
+            subWeightsAvx2(values, weights);
+            return;
+        }
+#endif
+#if defined(__SSE2__)
+        for(int i = 0; i < NNUE_HIDDEN; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+            v = _mm_sub_epi16(v, _mm_load_si128((const __m128i*)(weights + i)));
+            _mm_storeu_si128((__m128i*)(values + i), v);
+        }
+#else
+        for(int i = 0; i < NNUE_HIDDEN; ++i) {
+            values[i] -= weights[i];
+        }
+#endif
+    }
+
+    //Dot product of the clipped hidden layer with the output weights. At most NNUE_HIDDEN * QA * 32768,
+    //which still fits in an int.
+    static inline int clippedDot(const short* values, const short* weights) {
+#if defined(NNUE_AVX2)
+        if(useAvx2) {
+            return clippedDotAvx2(values, weights);
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ceiling = _mm_set1_epi16(QA);
+        __m128i sum = _mm_setzero_si128();
+
+        for(int i = 0; i < NNUE_HIDDEN; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+            v = _mm_min_epi16(_mm_max_epi16(v, zero), ceiling);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(v, _mm_load_si128((const __m128i*)(weights + i))));
+        }
+
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+#else
+        int sum = 0;
+
+        for(int i = 0; i < NNUE_HIDDEN; ++i) {
+            const int v = values[i] < 0 ? 0 : (values[i] > QA ? QA : values[i]);
+            sum += v * weights[i];
+        }
+
+        return sum;
+#endif
+    }
+
+    //File layout, all little endian: feature weights [768][256] and biases [256] as int16, output weights
+    //[2][256] as int16 and the output bias as int32
+    bool load(const std::string& fileName) {
+        std::ifstream file(fileName, std::ios::binary);
+
+        if(!file) {
+            printf("info string Could not open network file %s\n", fileName.c_str());
+            return false;
+        }
+
+        file.read((char*)featureWeights, sizeof(featureWeights));
+        file.read((char*)featureBiases, sizeof(featureBiases));
+        file.read((char*)outputWeights, sizeof(outputWeights));
+        file.read((char*)&outputBias, sizeof(outputBias));
+
+        if(!file || file.peek() != EOF) {
+            printf("info string Network file %s has the wrong size\n", fileName.c_str());
+            return false;
+        }
+
+        enabled = true;
+        printf("info string Using network %s\n", fileName.c_str());
+
+        return true;
+    }
+
+    void refresh(accumulator& acc, const gameState& state) {
+        for(int perspective = 0; perspective < 2; ++perspective) {
+            memcpy(acc.values[perspective], featureBiases, sizeof(featureBiases));
+
+            bitboard occupied = state.occupied;
+            while(occupied) {
+                const int sq = popLsb(occupied);
+                addWeights(acc.values[perspective], featureWeights[featureIndex(perspective, state.board[sq], sq)]);
+            }
+        }
+    }
+
+    void addPiece(accumulator& acc, int piece, int sq) {
+        addWeights(acc.values[0], featureWeights[featureIndex(0, piece, sq)]);
+        addWeights(acc.values[1], featureWeights[featureIndex(1, piece, sq)]);
+    }
+
+    void removePiece(accumulator& acc, int piece, int sq) {
+        subWeights(acc.values[0], featureWeights[featureIndex(0, piece, sq)]);
+        subWeights(acc.values[1], featureWeights[featureIndex(1, piece, sq)]);
+    }
+
+    void movePiece(accumulator& acc, int piece, int from, int to) {
+        for(int perspective = 0; perspective < 2; ++perspective) {
+            subWeights(acc.values[perspective], featureWeights[featureIndex(perspective, piece, from)]);
+            addWeights(acc.values[perspective], featureWeights[featureIndex(perspective, piece, to)]);
+        }
+    }
+
+    //Worked out in 64 bits since both halves together with the bias can pass the int range, and kept clear
+    //of the mate scores whatever the weights are
+    int evaluate(const accumulator& acc, int turnIndex) {
+        const int64_t sum = (int64_t)clippedDot(acc.values[turnIndex], outputWeights[0]) +
+            clippedDot(acc.values[turnIndex ^ 1], outputWeights[1]);
+        const int64_t score = (sum + outputBias) * OUTPUT_SCALE / (QA * QB);
+
+        return (int)std::max<int64_t>(-MATE_SCORE + 1, std::min<int64_t>(MATE_SCORE - 1, score));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <string>
+
+struct gameState;
+
+//Optional network evaluation. A single hidden layer is fed by one piece-square feature per piece and seen
+//from both sides, so the first layer (the accumulator) can be updated as pieces move instead of recomputed.
+namespace nnue {
+    #define NNUE_INPUTS 768
+    #define NNUE_HIDDEN 256
+
+    struct accumulator {
+        short values[2][NNUE_HIDDEN]; //Indexed by COLOUR_INDEX of the perspective
+    };
+
+    extern bool enabled;
+
+    //Reads the weights and turns the network on, leaves it off when the file can't be used
+    bool load(const std::string& fileName);
+
+    void refresh(accumulator& acc, const gameState& state);
+    void addPiece(accumulator& acc, int piece, int sq);
+    void removePiece(accumulator& acc, int piece, int sq);
+    void movePiece(accumulator& acc, int piece, int from, int to);
+
+    //Score for the side to move
+    int evaluate(const accumulator& acc, int turnIndex);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include <atomic>
+#include <cstdio>
+
+#include "pawntable.h"
+#include "statistics.h"
+
+//The table is shared by all search threads without a lock. The key is stored XORed with the data words,
+//so an entry torn by two threads writing at once no longer matches its key and is treated as a miss.
+struct pawn_slot {
+    std::atomic<unsigned long long> check;
+    std::atomic<unsigned long long> scores;
+    std::atomic<unsigned long long> passedPawns[2];
+};
+
+static pawn_slot* pawnTable;
+static int pawnTableSize;
+
+static inline unsigned long long packScores(const int scores[2]) {
+    return (unsigned long long)(unsigned int)scores[0] << 32 | (unsigned int)scores[1];
+}
+
+void initPawnTable(int sizeInBytes) {
+    pawnTableSize = sizeInBytes / sizeof(pawn_slot);
+    pawnTable = new pawn_slot[pawnTableSize];
+
+    //An empty slot is also the correct entry for a position without pawns, which hashes to 0
+    for(int i = 0; i < pawnTableSize; i++) {
+        pawnTable[i].check.store(0, std::memory_order_relaxed);
+        pawnTable[i].scores.store(0, std::memory_order_relaxed);
+        pawnTable[i].passedPawns[0].store(0, std::memory_order_relaxed);
+        pawnTable[i].passedPawns[1].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool probePawnTable(const gameState& gameState, pawn_entry& entry) {
+    const pawn_slot& slot = pawnTable[gameState.pawnHashCode % pawnTableSize];
+
+    const unsigned long long check = slot.check.load(std::memory_order_relaxed);
+    const unsigned long long scores = slot.scores.load(std::memory_order_relaxed);
+    entry.passedPawns[0] = slot.passedPawns[0].load(std::memory_order_relaxed);
+    entry.passedPawns[1] = slot.passedPawns[1].load(std::memory_order_relaxed);
+
+    if((check ^ scores ^ entry.passedPawns[0] ^ entry.passedPawns[1]) != gameState.pawnHashCode) {
+        countEvent(PAWN_MISSES);
+        return false;
+    }
+
+    entry.scores[0] = (int)(unsigned int)(scores >> 32);
+    entry.scores[1] = (int)(unsigned int)scores;
+    countEvent(PAWN_HITS);
+
+    return true;
+}
+
+void storePawnTable(const gameState& gameState, const pawn_entry& entry) {
+    pawn_slot& slot = pawnTable[gameState.pawnHashCode % pawnTableSize];
+    const unsigned long long scores = packScores(entry.scores);
+
+    slot.check.store(gameState.pawnHashCode ^ scores ^ entry.passedPawns[0] ^ entry.passedPawns[1], std::memory_order_relaxed);
+    slot.scores.store(scores, std::memory_order_relaxed);
+    slot.passedPawns[0].store(entry.passedPawns[0], std::memory_order_relaxed);
+    slot.passedPawns[1].store(entry.passedPawns[1], std::memory_order_relaxed);
+}
+
+void prefetchPawnTable(unsigned long long pawnHashCode) {
+    __builtin_prefetch(&pawnTable[pawnHashCode % pawnTableSize]);
+}
+
+void printPawnTableStatistics() {
+    const unsigned long long hits = counterTotal(PAWN_HITS);
+    const unsigned long long misses = counterTotal(PAWN_MISSES);
+
+    printf("Pawn hits: %llu\n", hits);
+    printf("Pawn misses: %llu\n", misses);
+    printf("Pawn hit %%: %.2f\n", (float)hits/(hits + misses) * 100);
+}
\ No newline at end of file
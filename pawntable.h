@@ -0,0 +1,17 @@
+#ifndef PAWNTABLE_H
+#define PAWNTABLE_H
+
+#include "game.h"
+
+struct pawn_entry {
+    int scores[2];           //Pawn structure score from white's point of view, indexed by GameStage
+    bitboard passedPawns[2]; //Indexed by COLOUR_INDEX
+};
+
+void initPawnTable(int sizeInBytes);
+bool probePawnTable(const gameState& gameState, pawn_entry& entry);
+void storePawnTable(const gameState& gameState, const pawn_entry& entry);
+void prefetchPawnTable(unsigned long long pawnHashCode);
+void printPawnTableStatistics();
+
+#endif
\ No newline at end of file
@@ -15,21 +15,19 @@ void perft(Game* game, int depth) {
     }
 
     move_list moves;
-    game->generateMoves(moves, false);
+    game->generateMoves(moves, GEN_ALL);
+
+    if(depth == 1) {
+        //Every generated move is legal so the leaves can just be counted
+        leafNodes += moves.numMoves;
+        return;
+    }
 
     for(int i = 0; i < moves.numMoves; ++i) {
         const move m = moves.moves[i];
 
         game->makeMove(m);
 
-        Colour turnBeforeMove = (Colour)-game->currentState.turn;
-
-        if((turnBeforeMove == WHITE && game->currentState.whiteInCheck) || (turnBeforeMove == BLACK && game->currentState.blackInCheck)) {
-            //Illegal move
-            game->undoLastMove();       
-            continue;
-        }
-
         perft(game, depth - 1);
 
         game->undoLastMove();
@@ -88,7 +86,7 @@ void perftDivide(Game* game, int depth) {
     std::cout << std::endl;
 
     move_list moves;
-    game->generateMoves(moves, false);
+    game->generateMoves(moves, GEN_ALL);
 
     int totalNodes = 0;
 
@@ -98,14 +96,6 @@ void perftDivide(Game* game, int depth) {
 
         game->makeMove(m);
 
-        Colour turnBeforeMove = (Colour)-game->currentState.turn;
-
-        if((turnBeforeMove == WHITE && game->currentState.whiteInCheck) || (turnBeforeMove == BLACK && game->currentState.blackInCheck)) {
-            //Illegal move
-            game->undoLastMove();       
-            continue;
-        }
-
         perft(game, depth - 1);
 
         game->undoLastMove();
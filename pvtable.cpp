@@ -1,72 +1,234 @@
 #include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <sys/mman.h>
 
 #include "pvtable.h"
+#include "search.h"
+#include "statistics.h"
 #include "utils.h"
 #include "debug.h"
 
-static pv_entry* pvTable;
-static int pvTableSize;
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
-static unsigned long long overwrites = 0;
-static unsigned long long collisions = 0;
-static unsigned long long hits = 0; 
-static unsigned long long misses = 0;
+static pv_cluster* pvTable = nullptr;
+static size_t pvTableSize; //In clusters
+static size_t pvTableBytes; //Size of the mapping, a whole number of huge pages
 
-void initPvTable(int sizeInBytes) {
-    pvTableSize = sizeInBytes / sizeof(pv_entry);
-    pvTable = new pv_entry[pvTableSize];
+//Bumped at the start of every search so entries left over from earlier searches can be told apart
+static unsigned char generation = 0;
 
-    for(int i = 0; i < pvTableSize; i++) {
-        pvTable[i] = NO_PV_ENTRY;
+#define MAX_GENERATION 64
+
+//Tries explicit 2MB huge pages first, then falls back to normal pages with a hint to back them with
+//transparent huge pages. Fresh anonymous pages are already zero, which is an empty table.
+//The size must be a multiple of HUGE_PAGE_SIZE.
+static void* allocateTable(size_t sizeInBytes) {
+    void* memory = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    memory = mmap(nullptr, sizeInBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+    if(memory == MAP_FAILED) {
+        memory = mmap(nullptr, sizeInBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(memory == MAP_FAILED) {
+            return nullptr;
+        }
+
+#ifdef MADV_HUGEPAGE
+        madvise(memory, sizeInBytes, MADV_HUGEPAGE);
+#endif
     }
+
+    return memory;
 }
 
-void addPvMove(const gameState& gameState, const move& m, int score, int depth, ScoreFlag scoreFlag) {
-    int index = gameState.hashCode % pvTableSize;
+//The new table is allocated before the old one is released, so on failure the old table stays in use
+bool initPvTable(size_t sizeInMb) {
+    const size_t sizeInBytes = sizeInMb * 1024 * 1024;
+    const size_t mappedBytes = (sizeInBytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    pv_cluster* table = (pv_cluster*)allocateTable(mappedBytes);
 
-    pv_entry existingEntry = pvTable[index];
+    if(table == nullptr) {
+        return false;
+    }
 
-    if(existingEntry.key != 0) {
-        //Existing entry at index
+    if(pvTable != nullptr) {
+        munmap(pvTable, pvTableBytes);
+    }
 
-        if(existingEntry.key == gameState.hashCode) {
-            //Writing new values for same position key
-            
-            if(existingEntry.depth <= depth) {
-                //New value has greater depth (more accurate score)
-                overwrites++;    
-            }
-            else {
-                //New value has lesser depth, don't overwrite
+    pvTable = table;
+    pvTableBytes = mappedBytes;
+    pvTableSize = sizeInBytes / sizeof(pv_cluster);
+    generation = 0;
+
+    return true;
+}
+
+//Each core zeroes its own slice, touching the pages from all of them at once
+void clearPvTable() {
+    const int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    const size_t slice = (pvTableSize + numThreads - 1) / numThreads;
+
+    for(int i = 0; i < numThreads; i++) {
+        const size_t start = std::min(pvTableSize, i * slice);
+        const size_t end = std::min(pvTableSize, start + slice);
+
+        threads.push_back(std::thread([start, end]() {
+            memset((void*)&pvTable[start], 0, (end - start) * sizeof(pv_cluster));
+        }));
+    }
+
+    for(auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+
+    generation = 0;
+}
+
+void newPvSearch() {
+    generation = (generation + 1) % MAX_GENERATION;
+}
+
+//Starts loading the cluster for a position into the cache ahead of getPvEntry
+void prefetchPvTable(unsigned long long hashCode) {
+    __builtin_prefetch(&pvTable[hashCode % pvTableSize]);
+}
+
+static inline unsigned short entryKey(const unsigned long long hashCode) {
+    return (unsigned short)(hashCode >> 48);
+}
+
+static inline packed_pv_entry unpackEntry(const unsigned long long data) {
+    packed_pv_entry entry;
+    memcpy(&entry, &data, sizeof(entry));
+    return entry;
+}
+
+static inline unsigned long long packEntry(const packed_pv_entry& entry) {
+    unsigned long long data;
+    memcpy(&data, &entry, sizeof(data));
+    return data;
+}
+
+static inline int entryGeneration(const packed_pv_entry& entry) {
+    return entry.genBound >> 2;
+}
+
+//How many searches ago the entry was last used
+static inline int entryAge(const packed_pv_entry& entry) {
+    return (MAX_GENERATION + generation - entryGeneration(entry)) % MAX_GENERATION;
+}
+
+//Mate scores sit just inside +-INFINITY, far outside 16 bits. They are moved to just inside +-SHRT_MAX
+//keeping their distance from the edge, everything else fits as it is.
+#define PACKED_MATE_SCORE (SHRT_MAX - MAX_PLY)
+
+static inline short packScore(const int score) {
+    if(score >= MATE_SCORE) {
+        return SHRT_MAX - (INFINITY - score);
+    }
+    if(score <= -MATE_SCORE) {
+        return -SHRT_MAX + (INFINITY + score);
+    }
+
+    return (short)std::max(-PACKED_MATE_SCORE + 1, std::min(PACKED_MATE_SCORE - 1, score));
+}
+
+static inline int unpackScore(const short score) {
+    if(score >= PACKED_MATE_SCORE) {
+        return INFINITY - (SHRT_MAX - score);
+    }
+    if(score <= -PACKED_MATE_SCORE) {
+        return -INFINITY + (SHRT_MAX + score);
+    }
+
+    return score;
+}
+
+void addPvMove(const gameState& gameState, const move& m, int score, int depth, ScoreFlag scoreFlag) {
+    pv_cluster& cluster = pvTable[gameState.hashCode % pvTableSize];
+    const unsigned short key = entryKey(gameState.hashCode);
+    int replaceIndex = 0;
+    packed_pv_entry replace = unpackEntry(cluster.entries[0].load(std::memory_order_relaxed));
+
+    for(int i = 0; i < PV_CLUSTER_SIZE; i++) {
+        const packed_pv_entry entry = unpackEntry(cluster.entries[i].load(std::memory_order_relaxed));
+
+        if(entry.key == key && entry.genBound != 0) {
+            //Writing new values for same position key, keep a deeper result from this search
+            if(entry.depth > depth && entryGeneration(entry) == generation) {
                 return;
             }
+
+            countEvent(PV_OVERWRITES);
+            replaceIndex = i;
+            replace = entry;
+            break;
         }
-        else {
-            //Hash key collision, overwrite
-            collisions++;
+
+        //Otherwise replace the least valuable entry, empty slots first then shallow and old entries
+        if(entry.genBound == 0) {
+            replaceIndex = i;
+            replace = entry;
+            break;
         }
+
+        if(entry.depth - 8 * entryAge(entry) < replace.depth - 8 * entryAge(replace)) {
+            replaceIndex = i;
+            replace = entry;
+        }
+    }
+
+    if(replace.genBound != 0 && replace.key != key) {
+        countEvent(PV_COLLISIONS);
     }
 
-    pvTable[index] = {
-        .key = gameState.hashCode,
-        .move = m,
-        .score = score,
-        .depth = depth,
-        .scoreFlag = scoreFlag
-    };
+    //Another thread may have changed the slot since it was read, in which case one of the two writes wins whole
+    cluster.entries[replaceIndex].store(packEntry(packed_pv_entry{
+        key,
+        m.data,
+        packScore(score),
+        (unsigned char)depth,
+        (unsigned char)(generation << 2 | scoreFlag)
+    }), std::memory_order_relaxed);
 }
 
 const pv_entry getPvEntry(const gameState& gameState) {
-    int index = gameState.hashCode % pvTableSize;
+    pv_cluster& cluster = pvTable[gameState.hashCode % pvTableSize];
+    const unsigned short key = entryKey(gameState.hashCode);
 
-    pv_entry entry = pvTable[index];
+    for(int i = 0; i < PV_CLUSTER_SIZE; i++) {
+        unsigned long long data = cluster.entries[i].load(std::memory_order_relaxed);
+        packed_pv_entry entry = unpackEntry(data);
 
-    if(entry.key == gameState.hashCode) {
-        hits++;
-        return entry;
+        //Every stored entry has a score flag, so an all zero bound marks an empty slot
+        if(entry.key == key && entry.genBound != 0) {
+            //Still useful, so don't let it age out. If another thread got to the slot first its write is kept.
+            if(entryGeneration(entry) != generation) {
+                entry.genBound = (unsigned char)(generation << 2 | (entry.genBound & 3));
+                cluster.entries[i].compare_exchange_strong(data, packEntry(entry), std::memory_order_relaxed);
+            }
+
+            countEvent(PV_HITS);
+
+            return pv_entry{
+                .key = gameState.hashCode,
+                .move = move{ entry.move },
+                .score = unpackScore(entry.score),
+                .depth = entry.depth,
+                .scoreFlag = (ScoreFlag)(entry.genBound & 3)
+            };
+        }
     }
-    
-    misses++;
+
+    countEvent(PV_MISSES);
 
     return NO_PV_ENTRY;
 }
@@ -76,16 +238,9 @@ void getPvLine(Game* game, std::vector<move>& pvMoves, int depth) {
         return;
     }
 
-    move_list availableMoves;
-    game->generateMoves(availableMoves, false);
-
     pv_entry pvEntry = getPvEntry(game->currentState);
 
-    if(pvEntry.move == NO_MOVE) {
-        return;
-    }
-
-    if(std::find(availableMoves.moves, availableMoves.moves + availableMoves.numMoves, pvEntry.move) == availableMoves.moves + availableMoves.numMoves) {
+    if(pvEntry.move == NO_MOVE || !game->isLegalMove(pvEntry.move)) {
         return;
     }
 
@@ -98,7 +253,29 @@ void getPvLine(Game* game, std::vector<move>& pvMoves, int depth) {
     game->undoLastMove();
 }
 
+//Permille of a sample of the table written during the current search, for the UCI hashfull report
+int pvTableFull() {
+    int used = 0;
+
+    for(int i = 0; i < 1000 / PV_CLUSTER_SIZE; i++) {
+        for(int j = 0; j < PV_CLUSTER_SIZE; j++) {
+            const packed_pv_entry entry = unpackEntry(pvTable[i].entries[j].load(std::memory_order_relaxed));
+
+            if(entry.genBound != 0 && entryGeneration(entry) == generation) {
+                used++;
+            }
+        }
+    }
+
+    return used * 1000 / (1000 / PV_CLUSTER_SIZE * PV_CLUSTER_SIZE);
+}
+
 void printPvStatistics() {
+    const unsigned long long hits = counterTotal(PV_HITS);
+    const unsigned long long misses = counterTotal(PV_MISSES);
+    const unsigned long long overwrites = counterTotal(PV_OVERWRITES);
+    const unsigned long long collisions = counterTotal(PV_COLLISIONS);
+
     printf("Hits: %llu\n", hits);
     printf("Misses: %llu\n", misses);
     printf("Hit %%: %.2f\n", (float)hits/(hits + misses) * 100);
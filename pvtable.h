@@ -1,6 +1,8 @@
 #ifndef PVTABLE_H
 #define PVTABLE_H
 
+#include <atomic>
+
 #include "game.h"
 
 enum ScoreFlag {
@@ -10,9 +12,10 @@ enum ScoreFlag {
     SCORE_BETA
 };
 
+//Unpacked view of a table entry as handed to the search
 struct pv_entry {
     unsigned long long key;
-    move move;
+    ::move move;
     int score;
     int depth;
     ScoreFlag scoreFlag;
@@ -30,12 +33,37 @@ struct pv_entry {
     }
 };
 
+//What is actually stored. Only the top 16 bits of the key are kept, the rest is implied by the index.
+//There is no static evaluation in here, the evaluation cache already holds it.
+struct packed_pv_entry {
+    unsigned short key;
+    unsigned short move;
+    short score;
+    unsigned char depth;
+    unsigned char genBound; //Generation in the top 6 bits, ScoreFlag in the bottom 2
+};
+
+static_assert(sizeof(packed_pv_entry) == sizeof(unsigned long long), "pv entries must fit in one word");
+
+//Entries sharing an index are kept together in one cache line. Each entry is read and written as a
+//single atomic word, so threads sharing the table never see half of one entry and half of another.
+#define PV_CLUSTER_SIZE 8
+
+struct alignas(64) pv_cluster {
+    std::atomic<unsigned long long> entries[PV_CLUSTER_SIZE];
+};
+
 #define NO_PV_ENTRY (pv_entry{.key = 0, .move = NO_MOVE, .score = 0, .depth = 0, .scoreFlag = SCORE_NONE})
 
-void initPvTable(int sizeInBytes);
+//Sizes are in megabytes, (re)allocating leaves an empty table. Returns false if the memory isn't available.
+bool initPvTable(size_t sizeInMb);
+void clearPvTable();
+void newPvSearch();
+void prefetchPvTable(unsigned long long hashCode);
 void addPvMove(const gameState& gameState, const move& m, int score, int depth, ScoreFlag scoreFlag);
 const pv_entry getPvEntry(const gameState& gameState);
 void getPvLine(Game* game, std::vector<move>& pvMoves, int depth);
+int pvTableFull();
 void printPvStatistics();
 
 #endif
\ No newline at end of file
@@ -1,71 +1,113 @@
 #include <algorithm>
+#include <cmath>
 
 #include "search.h"
+#include "movepicker.h"
 #include "pvtable.h"
 #include "evaluation.h"
 #include "debug.h"
 
 #include "utils.h"
 
-#define MOVE_EXISTS(moveList, move) (move != NO_MOVE && std::find(moveList.moves, moveList.moves + moveList.numMoves, move) != moveList.moves + moveList.numMoves)
-#define SORT_MOVES(moveList) (std::sort(moveList.moves, moveList.moves + moveList.numMoves, [](const move& a, const move& b) { return a.score > b.score; }))
-#define MOVE_IS_ILLEGAL(game, turn) ((turn == WHITE && game->currentState.whiteInCheck) || (turn == BLACK && game->currentState.blackInCheck))
-#define MOVE_SCORE_PV MOVE_SCORE_MAX
-
-bool isThreeRepetition(Game* game) {
+//Whether the position counts as a draw by repetition, only looking back to the last irreversible move.
+//Only positions with the same side to move can match, so every other key is skipped, and the last two
+//plies can't repeat it. A repeat inside the search is scored as a draw straight away since the side that
+//allowed it could repeat again, positions from before the root need two earlier occurrences.
+bool isRepetition(Game* game, int ply) {
+    const unsigned long long hashCode = game->currentState.hashCode;
+    const int end = game->historyLength - std::min(game->currentState.fiftyMove, game->historyLength);
+    const int root = game->historyLength - (ply - 1);
     int count = 0;
-    
-    for(auto it = game->stateHistory.begin(); it != game->stateHistory.end(); ++it) {
-        if(it->hashCode == game->currentState.hashCode) {
-            count++;
+
+    for(int i = game->historyLength - 4; i >= end; i -= 2) {
+        if(game->keyHistory[HISTORY_INDEX(i)] == hashCode) {
+            if(i >= root || ++count > 1) {
+                return true;
+            }
         }
     }
 
-    return count > 1;
+    return false;
 }
 
-const int quiesce(Game* game, int alpha, int beta, volatile bool* stop) {
-    if(*stop) {
-        return 0;
+#define NULL_MOVE_MIN_DEPTH 3
+#define NULL_MOVE_VERIFY_DEPTH 10
+
+#define DELTA_MARGIN 200
+//Delta pruning is off below this phase, in late endgames a single capture often decides the game
+#define DELTA_MIN_PHASE 6
+
+#define LMR_MIN_DEPTH 3
+#define LMR_MIN_MOVES 4
+
+//Depth reduction for late quiet moves, indexed by remaining depth and move number
+static int reductions[MAX_PLY][64];
+
+void initSearch() {
+    for(int depth = 1; depth < MAX_PLY; ++depth) {
+        for(int moveNumber = 1; moveNumber < 64; ++moveNumber) {
+            reductions[depth][moveNumber] = (int)(0.75 + std::log(depth) * std::log(moveNumber) / 2.25);
+        }
     }
+}
 
-    int score = evaluate(game);
+//Largest history score before all scores are halved, keeps recent cutoffs weighted over old ones
+#define MAX_HISTORY_SCORE (1 << 20)
 
-    if(score >= beta) {  
-        return score;
+//Records a quiet move that caused a beta cutoff so it is tried early in sibling and later positions
+static void updateQuietStats(search_thread* thread, const move& m, int depth, int ply) {
+    if(ply < MAX_PLY && thread->killers[ply][0] != m) {
+        thread->killers[ply][1] = thread->killers[ply][0];
+        thread->killers[ply][0] = m;
     }
 
-    if(score > alpha) {
-        alpha = score;
+    int (*history)[64] = thread->history[COLOUR_INDEX(thread->game.currentState.turn)];
+    history[m.from()][m.to()] += depth * depth;
+
+    if(history[m.from()][m.to()] > MAX_HISTORY_SCORE) {
+        for(int from = 0; from < 64; ++from) {
+            for(int to = 0; to < 64; ++to) {
+                history[from][to] /= 2;
+            }
+        }
     }
+}
 
-    pv_entry pvEntry = getPvEntry(game->currentState);
-    move pvMove = pvEntry.move;
+const int quiesce(search_thread* thread, int alpha, int beta, volatile bool* stop) {
+    if(*stop) {
+        return 0;
+    }
+
+    ++thread->nodes;
+    Game* game = &thread->game;
 
-    move_list captureMoves;
-    game->generateMoves(captureMoves, true);
+    const int standPat = evaluate(game);
 
-    if(MOVE_EXISTS(captureMoves, pvMove)) {
-        //There is still a small potential for hash collisions, need to check to make sure this move is actually an available move
-        pvMove.score = MOVE_SCORE_PV;
-        captureMoves.addMove(pvMove);
+    if(standPat >= beta) {
+        return standPat;
     }
 
-    SORT_MOVES(captureMoves);
+    if(standPat > alpha) {
+        alpha = standPat;
+    }
 
-    int turn = game->currentState.turn;
+    pv_entry pvEntry = getPvEntry(game->currentState);
 
-    for(int i = 0; i < captureMoves.numMoves; ++i) {
-        const move m = captureMoves.moves[i];
+    //Captures losing material by static exchange are never returned here
+    MovePicker picker(game, pvEntry.move, true);
+    move m;
 
-        game->makeMove(m);
+    const bool deltaPruning = game->currentState.phase >= DELTA_MIN_PHASE && game->hasNonPawnMaterial(game->currentState.turn);
 
-        if(MOVE_IS_ILLEGAL(game, turn)) {
-            game->undoLastMove();
+    while((m = picker.nextMove()) != NO_MOVE) {
+        //Delta pruning. Skip captures that can't bring the score back up to alpha even with a safety margin.
+        if(deltaPruning && standPat + game->captureGain(m) + DELTA_MARGIN <= alpha) {
             continue;
         }
 
-        int score = -quiesce(game, -beta, -alpha, stop);
+        game->makeMove(m);
+
+        int score = -quiesce(thread, -beta, -alpha, stop);
 
         game->undoLastMove();
 
@@ -81,23 +123,23 @@ const int quiesce(Game* game, int alpha, int beta, volatile bool* stop) {
     return alpha;
 }
 
-const int alphaBeta(Game* game, move& mv, int depth, int alpha, int beta, int ply, volatile bool* stop) {
+const int alphaBeta(search_thread* thread, move& mv, int depth, int alpha, int beta, int ply, volatile bool* stop, bool nullMoveAllowed) {
     if(*stop) {
         return 0;
     }
 
-    if(isThreeRepetition(game)) {
+    ++thread->nodes;
+    Game* game = &thread->game;
+
+    //Draw by repetition or the fifty move rule. The root still needs a move to play so is always searched.
+    if(ply > 1 && (game->currentState.fiftyMove >= 100 || isRepetition(game, ply))) {
         return 0;
     }
     
     pv_entry pvEntry = getPvEntry(game->currentState);
-    move pvMove = pvEntry.move;
 
-    move_list moves;
-    game->generateMoves(moves, false);
-
-    //TODO: Pretty sure this is not necessary
-    bool pvMoveIsValid = MOVE_EXISTS(moves, pvMove);
+    //There is still a small potential for hash collisions, need to check to make sure this move is actually an available move
+    bool pvMoveIsValid = pvEntry.move != NO_MOVE && game->isLegalMove(pvEntry.move);
 
     if(pvEntry != NO_PV_ENTRY && pvEntry.depth >= depth) {
         if(pvMoveIsValid) {
@@ -121,40 +163,87 @@ const int alphaBeta(Game* game, move& mv, int depth, int alpha, int beta, int pl
     }
 
     if(depth == 0) {
-        return quiesce(game, alpha, beta, stop);
+        return quiesce(thread, alpha, beta, stop);
     }
 
-    if(pvMoveIsValid) {
-        //There is still a small potential for hash collisions, need to check to make sure this move is actually an available move
-        pvMove.score = MOVE_SCORE_PV;
-        moves.addMove(pvMove);
+    //Null move pruning. If passing still fails high against a reduced search, a real move almost certainly
+    //would too. Not done in check, twice in a row, or with only pawns left where passing may be the best move.
+    //Only tried in null windows, a pv node needs an exact score and its best move.
+    const bool lastMoveWasNull = game->historyLength > 0 && game->history[HISTORY_INDEX(game->historyLength - 1)].move == NO_MOVE;
+
+    if(nullMoveAllowed && !lastMoveWasNull && beta - alpha == 1 && depth >= NULL_MOVE_MIN_DEPTH && !game->currentState.checkers &&
+        game->hasNonPawnMaterial(game->currentState.turn) && evaluate(game) >= beta) {
+        const int reduction = 3 + depth / 6;
+
+        game->makeNullMove();
+
+        move _;
+        int score = -alphaBeta(thread, _, std::max(0, depth - 1 - reduction), -beta, -beta + 1, ply + 1, stop);
+
+        game->undoNullMove();
+
+        if(score >= beta && !*stop) {
+            //A pass can't prove a mate
+            if(score >= MATE_SCORE) {
+                score = beta;
+            }
+
+            //Deep in the tree a wrong cutoff costs a lot, so confirm it with a normal reduced search of this
+            //position that isn't allowed to pass
+            if(depth < NULL_MOVE_VERIFY_DEPTH) {
+                return score;
+            }
+
+            if(alphaBeta(thread, _, depth - 1 - reduction, beta - 1, beta, ply, stop, false) >= beta) {
+                return score;
+            }
+        }
     }
 
-    SORT_MOVES(moves);
+    MovePicker picker(game, pvMoveIsValid ? pvEntry.move : NO_MOVE, false,
+        ply < MAX_PLY ? thread->killers[ply] : nullptr, thread->history[COLOUR_INDEX(game->currentState.turn)]);
 
+    const bool inCheck = game->currentState.checkers;
     int bestScore = -INFINITY;
     move bestMove = NO_MOVE;
-    bool anyMoves = false;
     int oldAlpha = alpha;
-    int turn = game->currentState.turn;    
+    int movesSearched = 0;
+    move m;
+
+    while((m = picker.nextMove()) != NO_MOVE) {
+        ++movesSearched;
 
-    for(int i = 0; i < moves.numMoves; ++i) {
-        const move m = moves.moves[i];
+        const bool isQuiet = !game->isCapture(m) && m.flag() != MOVE_PROMOTION;
 
         game->makeMove(m);
 
-        //We have to actually make a move to see if it is legal in terms of not leaving the player in check
-        //which we defer to checking here as moves may be skipped by alpha-beta pruning in which case we never
-        //actually need to check this
-        if(MOVE_IS_ILLEGAL(game, turn)) {
-            game->undoLastMove();
-            continue;
-        }
+        //Late move reductions. Moves this far down the ordering rarely raise alpha, so quiet ones are first
+        //searched shallower and only searched fully if that beats alpha.
+        int reduction = 0;
 
-        anyMoves = true;
+        if(depth >= LMR_MIN_DEPTH && movesSearched >= LMR_MIN_MOVES && isQuiet && !inCheck && !game->currentState.checkers) {
+            reduction = std::min(depth - 2, reductions[std::min(depth, MAX_PLY - 1)][std::min(movesSearched, 63)]);
+        }
 
         move _;
-        int score = -alphaBeta(game, _, depth - 1, -beta, -alpha, ply + 1, stop);
+        int score;
+
+        //Principal variation search. The first move is expected to be best, every later move only has to be
+        //shown to be no better with a null window, and is searched again with the full window if it is.
+        if(movesSearched == 1) {
+            score = -alphaBeta(thread, _, depth - 1, -beta, -alpha, ply + 1, stop);
+        }
+        else {
+            score = -alphaBeta(thread, _, depth - 1 - reduction, -alpha - 1, -alpha, ply + 1, stop);
+
+            if(score > alpha && reduction > 0) {
+                score = -alphaBeta(thread, _, depth - 1, -alpha - 1, -alpha, ply + 1, stop);
+            }
+
+            if(score > alpha && score < beta) {
+                score = -alphaBeta(thread, _, depth - 1, -beta, -alpha, ply + 1, stop);
+            }
+        }
 
         game->undoLastMove();
 
@@ -166,6 +255,10 @@ const int alphaBeta(Game* game, move& mv, int depth, int alpha, int beta, int pl
                 alpha = score;
 
                 if(alpha >= beta) {
+                    if(isQuiet) {
+                        updateQuietStats(thread, m, depth, ply);
+                    }
+
                     if(!*stop) {
                         addPvMove(game->currentState, bestMove, beta, depth, SCORE_BETA);
                     }
@@ -176,11 +269,11 @@ const int alphaBeta(Game* game, move& mv, int depth, int alpha, int beta, int pl
         }
     }   
 
-    if(!anyMoves && (turn == WHITE ? game->currentState.whiteInCheck : game->currentState.blackInCheck)) {
+    if(movesSearched == 0 && game->currentState.checkers) {
         //Check mate. Current player is in check and there are no legal moves available
         return -INFINITY + ply;
     }
-    else if(!anyMoves) {
+    else if(movesSearched == 0) {
         return 0;
     }
 
@@ -3,7 +3,26 @@
 
 #include "game.h"
 
-const int quiesce(Game* game, int alpha, int beta, volatile bool* stop);
-const int alphaBeta(Game* game, move& mv, int depth, int alpha, int beta, int ply, volatile bool* stop);
+#define MAX_PLY 128
+
+//The repetition window plus a search line, and a ponder search on top of the move just played
+static_assert(HISTORY_SIZE >= MAX_FIFTY_MOVE + 2 * MAX_PLY, "history ring too small for the search");
+
+//Scores past this are a forced mate found within the search
+#define MATE_SCORE (INFINITY - MAX_PLY)
+
+//State owned by one search thread. Each thread searches its own copy of the game, only the pv table and
+//evaluation caches are shared between threads.
+struct search_thread {
+    Game game;
+    int id; //0 for the main thread
+    move killers[MAX_PLY][2];  //Quiet moves that caused a beta cutoff, most recent first
+    int history[2][64][64];    //Cutoff counts of quiet moves, indexed by COLOUR_INDEX of the mover, from and to
+    unsigned long long nodes;  //Positions visited by alphaBeta and quiesce
+};
+
+void initSearch();
+const int quiesce(search_thread* thread, int alpha, int beta, volatile bool* stop);
+const int alphaBeta(search_thread* thread, move& mv, int depth, int alpha, int beta, int ply, volatile bool* stop, bool nullMoveAllowed = true);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "statistics.h"
+
+static std::mutex countersMutex;
+static std::vector<thread_counters*> liveCounters;
+//Counts of threads that have already finished
+static unsigned long long retiredCounts[NUM_COUNTERS] = {};
+
+__thread thread_counters localCounters;
+
+counter_registration::counter_registration() {
+    for(int i = 0; i < NUM_COUNTERS; i++) {
+        localCounters.counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(countersMutex);
+    liveCounters.push_back(&localCounters);
+}
+
+counter_registration::~counter_registration() {
+    std::lock_guard<std::mutex> lock(countersMutex);
+
+    for(int i = 0; i < NUM_COUNTERS; i++) {
+        retiredCounts[i] += localCounters.counts[i].load(std::memory_order_relaxed);
+        localCounters.counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    liveCounters.erase(std::find(liveCounters.begin(), liveCounters.end(), &localCounters));
+}
+
+unsigned long long counterTotal(const Counter counter) {
+    std::lock_guard<std::mutex> lock(countersMutex);
+    unsigned long long total = retiredCounts[counter];
+
+    for(auto it = liveCounters.begin(); it != liveCounters.end(); ++it) {
+        total += (*it)->counts[counter].load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <atomic>
+
+//Event counters for the tables shared by the search threads
+enum Counter {
+    PV_HITS,
+    PV_MISSES,
+    PV_OVERWRITES,
+    PV_COLLISIONS,
+    PAWN_HITS,
+    PAWN_MISSES,
+    EVAL_HITS,
+    EVAL_MISSES,
+    NUM_COUNTERS
+};
+
+//Every thread counts into its own cache line. Only the owner writes its counters, so relaxed loads and
+//stores are enough, and the totals are summed up when they are read. The counters are trivially
+//constructible and declared __thread, so counting needs no initialisation check the way thread_local would.
+struct alignas(64) thread_counters {
+    std::atomic<unsigned long long> counts[NUM_COUNTERS];
+};
+
+extern __thread thread_counters localCounters;
+
+inline void countEvent(const Counter counter) {
+    std::atomic<unsigned long long>& count = localCounters.counts[counter];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+//Held for the life of every thread that probes the tables. Makes the thread's counts visible to counterTotal
+//and folds them into the totals when it goes out of scope.
+struct counter_registration {
+    counter_registration();
+    ~counter_registration();
+};
+
+//Sum over every registered thread and every thread that has finished
+unsigned long long counterTotal(const Counter counter);
+
+#endif
\ No newline at end of file
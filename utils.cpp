@@ -116,18 +116,18 @@ const CastlePerm getCastlePerm(const char c) {
     exit(1);
 }
 
-const enPassLocation getEnPassLocation(const char c1, const char c2) {
-    return EN_PASS((unsigned int)(c1 - 'a'), (unsigned int)(7 - (c2 - '0' - 1)));
+const unsigned int getEnPassLocation(const char c1, const char c2) {
+    return SQUARE((unsigned int)(7 - (c2 - '0' - 1)), (unsigned int)(c1 - 'a'));
 }
 
 const std::string getMoveStr(const move& move) {
     std::string s = std::string() + 
-        (char)('a' + move.fromX) + 
-        std::to_string(8 - move.fromY) + 
-        (char)('a' + move.toX) + 
-        std::to_string(8 - move.toY);
+        (char)('a' + COL_OF(move.from())) + 
+        std::to_string(8 - ROW_OF(move.from())) + 
+        (char)('a' + COL_OF(move.to())) + 
+        std::to_string(8 - ROW_OF(move.to()));
 
-    char promotion = getPiecePromotionChar(move.promotion);
+    char promotion = getPiecePromotionChar(move.promotion());
     if(promotion) {
         s += promotion;
     }
@@ -135,25 +135,19 @@ const std::string getMoveStr(const move& move) {
     return s;
 }
 
-const move getMove(const std::string& moveStr) {
-    PieceType promotion = Empty;
+//The move string does not say whether a move is castling, en passant or a promotion, so find the matching legal move
+const move getMove(Game* game, const std::string& moveStr) {
+    move_list moves;
+    game->generateMoves(moves, GEN_ALL);
 
-    if(moveStr.length() > 4) {
-        promotion = getPiecePromotionType(moveStr.at(4));
+    for(int i = 0; i < moves.numMoves; ++i) {
+        if(getMoveStr(moves.moves[i]) == moveStr) {
+            return moves.moves[i];
+        }
     }
 
-    unsigned int fromX = moveStr.at(0) - 'a';
-    unsigned int fromY = 7 - (moveStr.at(1) - '0' - 1);
-    unsigned int toX = moveStr.at(2) - 'a';
-    unsigned int toY = 7 - (moveStr.at(3) - '0' - 1);
-
-    return {  
-        fromX,
-        fromY,
-        toX,
-        toY,
-        promotion
-    };
+    LOG(std::string("Unknown move ") + moveStr);
+    return NO_MOVE;
 }
 
 const long long getCurrentTimeInMs() {
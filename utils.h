@@ -18,9 +18,9 @@ const Piece getPiece(const char c, const Colour turn);
 const Piece getPiece(PieceType pieceType, const Colour turn);
 const Colour getTurn(const char c);
 const CastlePerm getCastlePerm(const char c);
-const enPassLocation getEnPassLocation(const char c1, const char c2);
+const unsigned int getEnPassLocation(const char c1, const char c2);
 const std::string getMoveStr(const move& move);
-const move getMove(const std::string& moveStr);
+const move getMove(Game* game, const std::string& moveStr);
 const long long getCurrentTimeInMs();
 
 #endif
\ No newline at end of file